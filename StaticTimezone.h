@@ -0,0 +1,140 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * StaticTimezone: a time zone whose rules are fixed at build time,     *
+ * given as template parameters. All the rule arithmetic is constexpr,  *
+ * so the compiler folds it, and tables of time changes can be          *
+ * generated at compile time into flash.                                *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef StaticTimezone_h
+#define StaticTimezone_h
+#include "Timezone.h"
+
+#ifdef __AVR__
+    #include <avr/pgmspace.h>
+#endif
+#ifndef PROGMEM
+    #define PROGMEM
+#endif
+
+// compile time sequence of indices 0, 1, ... N-1 (std::index_sequence is C++14)
+template <int... I> struct TimeChangeIndices {};
+template <int N, int... I> struct MakeTimeChangeIndices : MakeTimeChangeIndices<N - 1, N - 1, I...> {};
+template <int... I> struct MakeTimeChangeIndices<0, I...> { typedef TimeChangeIndices<I...> type; };
+
+// table of the time changes of the zone Z, two per year from firstYear,
+// generated at compile time (in flash on avr)
+template <class Z, int firstYear, class I> struct StaticTimeChanges;
+template <class Z, int firstYear, int... I> struct StaticTimeChanges<Z, firstYear, TimeChangeIndices<I...> >
+{
+    static const TimeChange changes[sizeof...(I)];
+};
+template <class Z, int firstYear, int... I>
+const TimeChange StaticTimeChanges<Z, firstYear, TimeChangeIndices<I...> >::changes[sizeof...(I)] PROGMEM =
+    { Z::change(firstYear + I / 2, I % 2)... };
+
+// The rules must be constexpr objects with static storage duration, e.g.:
+//   constexpr TimeChangeRule CEST = {"CEST", Last, Sun, Mar, 2, 120, 0, 0};
+//   constexpr TimeChangeRule CET = {"CET", Last, Sun, Oct, 3, 60, 0, 0};
+//   typedef StaticTimezone<CEST, CET> CE;
+//   local = CE::toLocal(utc);
+// For a zone that does not observe daylight time, give the same rule twice:
+// conversions are then folded to a single add.
+template <const TimeChangeRule &DST, const TimeChangeRule &STD>
+class StaticTimezone
+{
+    public:
+        // true if daylight time is not observed, i.e. offsets are the same
+        static constexpr bool isFixed()
+        {
+            return DST.offset == STD.offset;
+        }
+
+        // dst and std time start for the given year (years since 1900), given in UTC
+        static constexpr time_t dstUTC(int yr)
+        {
+            return Timezone::changeTime(DST, yr) - STD.offset * (long) SECS_PER_MIN;
+        }
+        static constexpr time_t stdUTC(int yr)
+        {
+            return Timezone::changeTime(STD, yr) - DST.offset * (long) SECS_PER_MIN;
+        }
+
+        // dst and std time start for the given year (years since 1900), given in local time
+        static constexpr time_t dstLoc(int yr)
+        {
+            return Timezone::changeTime(DST, yr);
+        }
+        static constexpr time_t stdLoc(int yr)
+        {
+            return Timezone::changeTime(STD, yr);
+        }
+
+        static constexpr bool utcIsDST(time_t utc)
+        {
+            return !isFixed() && isDST(utc, dstUTC(Timezone::yearOf(utc)), stdUTC(Timezone::yearOf(utc)));
+        }
+
+        static constexpr bool locIsDST(time_t local)
+        {
+            return !isFixed() && isDST(local, dstLoc(Timezone::yearOf(local)), stdLoc(Timezone::yearOf(local)));
+        }
+
+        static constexpr time_t toLocal(time_t utc)
+        {
+            return utc + (utcIsDST(utc) ? DST.offset : STD.offset) * (long) SECS_PER_MIN;
+        }
+
+        static time_t toLocal(time_t utc, const TimeChangeRule **tcr)
+        {
+            *tcr = utcIsDST(utc) ? &DST : &STD;
+            return utc + (*tcr)->offset * (long) SECS_PER_MIN;
+        }
+
+        // same caveats as Timezone::toUTC() for local times during a transition interval
+        static constexpr time_t toUTC(time_t local)
+        {
+            return local - (locIsDST(local) ? DST.offset : STD.offset) * (long) SECS_PER_MIN;
+        }
+
+        // c-th time change (0 or 1) of the given calendar year, in time order.
+        // Without daylight time both are standard time from the start of
+        // the year, as the single change written by Timezone::makeTable().
+        static constexpr TimeChange change(int year, int c)
+        {
+            return isFixed() || stdUTC(year - 1900) == dstUTC(year - 1900)
+                ? TimeChange{(time_t) (Timezone::daysFromCivil(year, 1, 1) - EPOCH_DAYS) * SECS_PER_DAY, STD.offset, 0}
+                : (stdUTC(year - 1900) > dstUTC(year - 1900)) == (c == 0)
+                ? TimeChange{dstUTC(year - 1900), DST.offset, 1}
+                : TimeChange{stdUTC(year - 1900), STD.offset, 0};
+        }
+
+        // table of the time changes from firstYear to lastYear included,
+        // computed at compile time and stored in flash on avr
+        template <int firstYear, int lastYear>
+        static TimeChangeTable table()
+        {
+            typedef StaticTimeChanges<StaticTimezone, firstYear,
+                typename MakeTimeChangeIndices<2 * (lastYear - firstYear + 1)>::type> T;
+#ifdef __AVR__
+            return TimeChangeTable(T::changes, 2 * (lastYear - firstYear + 1), true);
+#else
+            return TimeChangeTable(T::changes, 2 * (lastYear - firstYear + 1));
+#endif
+        }
+
+    private:
+        // same classification as Timezone::utcIsDST_r()/locIsDST_r()
+        static constexpr bool isDST(time_t t, time_t dst, time_t std)
+        {
+            return std == dst ? false                       // daylight time not observed in this tz
+                : std > dst ? (t >= dst && t < std)         // northern hemisphere
+                : !(t >= std && t < dst);                   // southern hemisphere
+        }
+};
+#endif
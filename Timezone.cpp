@@ -26,7 +26,75 @@
 
 #ifdef __AVR__
     #include <avr/eeprom.h>
+    #include <avr/pgmspace.h>
 #endif
+#ifndef PROGMEM
+    #define PROGMEM
+#endif
+#if defined(TZ_STATS_CYCLES) && !defined(TZ_CYCLES)
+    #if defined(__x86_64__) || defined(__i386__)
+        #include <x86intrin.h>
+        #define TZ_CYCLES() __rdtsc()
+    #else
+        #error "TZ_STATS_CYCLES needs a TZ_CYCLES() cycle counter on this platform"
+    #endif
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifdef TZ_STATS
+/*----------------------------------------------------------------------*
+ * Count a call of the enclosing function and, with TZ_STATS_CYCLES,    *
+ * its duration in cycles, until the end of the scope.                  *
+ *----------------------------------------------------------------------*/
+struct StatsCall
+{
+    StatsCall(TimezoneStats &stats, tzCall_t call) : m_stats(stats), m_call(call)
+    {
+        m_stats.calls[call]++;
+#ifdef TZ_STATS_CYCLES
+        m_start = TZ_CYCLES();
+#endif
+    }
+#ifdef TZ_STATS_CYCLES
+    ~StatsCall()
+    {
+        unsigned long long cycles = TZ_CYCLES() - m_start;
+        uint8_t bin = 0;
+
+        while (cycles >>= 1) bin++;
+        m_stats.cycles[m_call][bin < TZ_STATS_BINS ? bin : TZ_STATS_BINS - 1]++;
+    }
+    unsigned long long m_start;
+#endif
+    TimezoneStats &m_stats;
+    tzCall_t m_call;
+};
+    #define STATS_CALL(call)    StatsCall statsCall(m_stats, call)
+    #define STATS_COUNT(n, tc)  do { if ((tc) == &m_tc) m_stats.n++; } while (0)   // own cache only
+#else
+    #define STATS_CALL(call)
+    #define STATS_COUNT(n, tc)
+#endif
+
+/*----------------------------------------------------------------------*
+ * Recalculate the time change points if the given time, UTC or local,  *
+ * is not in the year they are cached for.                              *
+ *----------------------------------------------------------------------*/
+inline void Timezone::checkTimeChanges(time_t t, TimeChanges *tc) const
+{
+    if (t < tc->yrStart || t >= tc->yrEnd) {
+        STATS_COUNT(misses, tc);
+        calcTimeChanges(yearOf(t), tc);
+    }
+    else {
+        STATS_COUNT(hits, tc);
+    }
+}
 
 /*----------------------------------------------------------------------*
  * Create a Timezone object from the given time change rules.           *
@@ -35,6 +103,9 @@ Timezone::Timezone(TimeChangeRule dstStart, TimeChangeRule stdStart)
     : m_dst(dstStart), m_std(stdStart)
 {
     initTimeChanges();
+#ifdef TZ_STATS
+    resetStats();
+#endif
 }
 
 /*----------------------------------------------------------------------*
@@ -45,6 +116,9 @@ Timezone::Timezone(TimeChangeRule stdTime)
     : m_dst(stdTime), m_std(stdTime)
 {
     initTimeChanges();
+#ifdef TZ_STATS
+    resetStats();
+#endif
 }
 
 #ifdef __AVR__
@@ -55,6 +129,9 @@ Timezone::Timezone(TimeChangeRule stdTime)
 Timezone::Timezone(int address)
 {
     readRules(address);
+#ifdef TZ_STATS
+    resetStats();
+#endif
 }
 #endif
 
@@ -64,18 +141,8 @@ Timezone::Timezone(int address)
  *----------------------------------------------------------------------*/
 time_t Timezone::toLocal(time_t utc)
 {
-    struct tm utc_tm;
-
-    // Conversion from time_t to struct tm to compare years
-    gmtime_r(&utc, &utc_tm);
-
-    // Recalculate the time change points if needed
-    if (utc_tm.tm_year != m_tm_dstUTC.tm_year) calcTimeChanges(utc_tm.tm_year);
-
-    if (utcIsDST(utc))
-        return utc + m_dst.offset * SECS_PER_MIN;
-    else
-        return utc + m_std.offset * SECS_PER_MIN;
+    STATS_CALL(StatToLocal);
+    return toLocal_r(utc, &m_tc);
 }
 
 /*----------------------------------------------------------------------*
@@ -86,28 +153,15 @@ time_t Timezone::toLocal(time_t utc)
  *----------------------------------------------------------------------*/
 time_t Timezone::toLocal(time_t utc, TimeChangeRule **tcr)
 {
-    struct tm utc_tm;
-
-    // Conversion from time_t to struct tm to compare years
-    gmtime_r(&utc, &utc_tm);
-
-    // Recalculate the time change points if needed
-    if (utc_tm.tm_year != m_tm_dstUTC.tm_year) calcTimeChanges(utc_tm.tm_year);
-
-    if (utcIsDST(utc)) {
-        *tcr = &m_dst;
-        return utc + m_dst.offset * SECS_PER_MIN;
-    }
-    else {
-        *tcr = &m_std;
-        return utc + m_std.offset * SECS_PER_MIN;
-    }
+    STATS_CALL(StatToLocalTcr);
+    return toLocal_r(utc, &m_tc, (const TimeChangeRule **) tcr);
 }
 
 time_t Timezone::toLocal(time_t utc, struct tm *tm_local, TimeChangeRule **tcr)
 {
+    STATS_CALL(StatToLocalTm);
     memset((void*) tm_local, 0, sizeof(*tm_local));
-    time_t local = toLocal(utc, tcr);
+    time_t local = toLocal_r(utc, &m_tc, (const TimeChangeRule **) tcr);
     gmtime_r(&local, tm_local);
 
     return local;
@@ -115,14 +169,69 @@ time_t Timezone::toLocal(time_t utc, struct tm *tm_local, TimeChangeRule **tcr)
 
 time_t Timezone::toLocal(struct tm *tm_utc, struct tm *tm_local, TimeChangeRule **tcr)
 {
+    STATS_CALL(StatToLocalTmTm);
     memset((void*) tm_local, 0, sizeof(*tm_local));
     time_t utc = mk_gmtime(tm_utc);
-    time_t local = toLocal(utc, tcr);
+    time_t local = toLocal_r(utc, &m_tc, (const TimeChangeRule **) tcr);
     gmtime_r(&local, tm_local);
 
     return local;
 }
 
+/*----------------------------------------------------------------------*
+ * Convert an array of n UTC times to local times (utc and local may    *
+ * be the same array). The time change points are looked up once per    *
+ * run of elements falling in the same year, each element is then       *
+ * classified against the cached dstUTC/stdUTC only.                    *
+ *----------------------------------------------------------------------*/
+void Timezone::toLocal(const time_t *utc, time_t *local, size_t n)
+{
+    time_t yrStart, yrEnd, dstUTC, stdUTC, t;
+    long dstOffset = m_dst.offset * (long) SECS_PER_MIN;
+    long stdOffset = m_std.offset * (long) SECS_PER_MIN;
+    size_t i = 0;
+    STATS_CALL(StatToLocalN);
+
+    while (i < n) {
+        // Recalculate the time change points if needed
+        t = utc[i];
+        checkTimeChanges(t, &m_tc);
+        yrStart = m_tc.yrStart;
+        yrEnd = m_tc.yrEnd;
+        dstUTC = m_tc.dstUTC;
+        stdUTC = m_tc.stdUTC;
+
+        // Convert all the following elements within the same year
+        if (stdUTC == dstUTC) {             // daylight time not observed in this tz
+            for (; i < n && (t = utc[i]) >= yrStart && t < yrEnd; i++)
+                local[i] = t + stdOffset;
+        }
+        else if (stdUTC > dstUTC) {         // northern hemisphere
+            for (; i < n && (t = utc[i]) >= yrStart && t < yrEnd; i++)
+                local[i] = t + ((t >= dstUTC && t < stdUTC) ? dstOffset : stdOffset);
+        }
+        else {                              // southern hemisphere
+            for (; i < n && (t = utc[i]) >= yrStart && t < yrEnd; i++)
+                local[i] = t + ((t >= stdUTC && t < dstUTC) ? stdOffset : dstOffset);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Reentrant version of toLocal(): the time change points are cached    *
+ * in the given TimeChanges, owned by the caller, and the object is     *
+ * never modified. Several threads can share a Timezone this way, each  *
+ * one with its own TimeChanges, without any lock. If tcr is not NULL,  *
+ * it returns a pointer to the time change rule used.                   *
+ *----------------------------------------------------------------------*/
+time_t Timezone::toLocal_r(time_t utc, TimeChanges *tc, const TimeChangeRule **tcr) const
+{
+    const TimeChangeRule *r = utcIsDST_r(utc, tc) ? &m_dst : &m_std;
+
+    if (tcr) *tcr = r;
+    return utc + r->offset * (long) SECS_PER_MIN;
+}
+
 /*----------------------------------------------------------------------*
  * Convert the given local time to UTC time.                            *
  *                                                                      *
@@ -150,40 +259,141 @@ time_t Timezone::toLocal(struct tm *tm_utc, struct tm *tm_local, TimeChangeRule
  *----------------------------------------------------------------------*/
 time_t Timezone::toUTC(time_t local)
 {
-    struct tm tm_local;
+    STATS_CALL(StatToUTC);
+    return toUTC_r(local, &m_tc);
+}
 
-    // Conversion from time_t to struct tm to compare years
-    gmtime_r(&local, &tm_local);
+/*----------------------------------------------------------------------*
+ * Convert an array of n local times to UTC times (local and utc may    *
+ * be the same array), with the same caveats as toUTC(time_t) about     *
+ * the local times during a transition interval. The time change        *
+ * points are looked up once per run of elements in the same year.      *
+ *----------------------------------------------------------------------*/
+void Timezone::toUTC(const time_t *local, time_t *utc, size_t n)
+{
+    time_t yrStart, yrEnd, dstLoc, stdLoc, t;
+    long dstOffset = m_dst.offset * (long) SECS_PER_MIN;
+    long stdOffset = m_std.offset * (long) SECS_PER_MIN;
+    size_t i = 0;
+    STATS_CALL(StatToUTCN);
 
-    // Recalculate the time change points if needed
-    if (tm_local.tm_year != m_tm_dstLoc.tm_year) calcTimeChanges(tm_local.tm_year);
+    while (i < n) {
+        // Recalculate the time change points if needed
+        t = local[i];
+        checkTimeChanges(t, &m_tc);
+        yrStart = m_tc.yrStart;
+        yrEnd = m_tc.yrEnd;
+        dstLoc = m_tc.dstLoc;
+        stdLoc = m_tc.stdLoc;
 
-    if (locIsDST(local))
-        return local - m_dst.offset * SECS_PER_MIN;
+        // Convert all the following elements within the same year
+        if (m_tc.stdUTC == m_tc.dstUTC) {   // daylight time not observed in this tz
+            for (; i < n && (t = local[i]) >= yrStart && t < yrEnd; i++)
+                utc[i] = t - stdOffset;
+        }
+        else if (stdLoc > dstLoc) {         // northern hemisphere
+            for (; i < n && (t = local[i]) >= yrStart && t < yrEnd; i++)
+                utc[i] = t - ((t >= dstLoc && t < stdLoc) ? dstOffset : stdOffset);
+        }
+        else {                              // southern hemisphere
+            for (; i < n && (t = local[i]) >= yrStart && t < yrEnd; i++)
+                utc[i] = t - ((t >= stdLoc && t < dstLoc) ? stdOffset : dstOffset);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Reentrant version of toUTC(), see toLocal_r().                       *
+ *----------------------------------------------------------------------*/
+time_t Timezone::toUTC_r(time_t local, TimeChanges *tc) const
+{
+    if (locIsDST_r(local, tc))
+        return local - m_dst.offset * (long) SECS_PER_MIN;
     else
-        return local - m_std.offset * SECS_PER_MIN;
+        return local - m_std.offset * (long) SECS_PER_MIN;
 }
 
 /*----------------------------------------------------------------------*
- * Determine whether the given UTC time_t is within the DST interval    *
- * or the Standard time interval.                                       *
+ * Convert the given local time to UTC time, resolving the local times  *
+ * during a transition interval with the given policy:                  *
+ *  - Fold (the time occurs twice): Earlier and ShiftForward return     *
+ *    the first occurrence, before the time change, Later the second    *
+ *    one.                                                              *
+ *  - Gap (the time is skipped): Earlier and Later return the instant   *
+ *    of the time change, ShiftForward the time shifted forward by the  *
+ *    length of the gap (e.g. 02:30 becomes 03:30 daylight time).       *
+ *  - Reject: returns false for both, utc is not set.                   *
+ * If type is not NULL, it returns whether the local time is Valid, in  *
+ * a Gap or in a Fold.                                                  *
  *----------------------------------------------------------------------*/
-bool Timezone::utcIsDST(time_t utc)
+bool Timezone::toUTC(time_t local, time_t *utc, localPolicy_t policy, localTime_t *type)
 {
-    struct tm utc_tm;
+    STATS_CALL(StatToUTCPolicy);
+    return toUTC_r(local, utc, policy, &m_tc, type);
+}
+
+/*----------------------------------------------------------------------*
+ * Type of the given local time, around a time change at the local      *
+ * time at (given with the offset before), from the offset before to    *
+ * the offset after, in seconds.                                        *
+ *----------------------------------------------------------------------*/
+static localTime_t localType(time_t local, time_t at, long before, long after)
+{
+    if (after > before && local >= at && local < at + (after - before))
+        return Gap;
+    if (after < before && local >= at - (before - after) && local < at)
+        return Fold;
+    return Valid;
+}
 
-    // Conversion from time_t to struct tm to compare years
-    gmtime_r(&utc, &utc_tm);
+/*----------------------------------------------------------------------*
+ * Reentrant version of toUTC() with a policy, see toLocal_r().         *
+ *----------------------------------------------------------------------*/
+bool Timezone::toUTC_r(time_t local, time_t *utc, localPolicy_t policy, TimeChanges *tc, localTime_t *type) const
+{
+    long dstOffset = m_dst.offset * (long) SECS_PER_MIN;
+    long stdOffset = m_std.offset * (long) SECS_PER_MIN;
+    long before = 0, after = 0;
+    localTime_t lt = Valid;
+    time_t at = 0;
 
     // Recalculate the time change points if needed
-    if (utc_tm.tm_year != m_tm_dstUTC.tm_year) calcTimeChanges(utc_tm.tm_year);
+    checkTimeChanges(local, tc);
+
+    // dstLoc is given in standard time, stdLoc in daylight time
+    if (tc->stdUTC != tc->dstUTC) {
+        if ((lt = localType(local, tc->dstLoc, stdOffset, dstOffset)) != Valid) {
+            at = tc->dstLoc;
+            before = stdOffset;
+            after = dstOffset;
+        }
+        else if ((lt = localType(local, tc->stdLoc, dstOffset, stdOffset)) != Valid) {
+            at = tc->stdLoc;
+            before = dstOffset;
+            after = stdOffset;
+        }
+    }
+    if (type) *type = lt;
 
-    if (m_stdUTC == m_dstUTC)       // daylight time not observed in this tz
+    if (lt == Valid)
+        *utc = local - (locIsDST_r(local, tc) ? dstOffset : stdOffset);
+    else if (policy == Reject)
         return false;
-    else if (m_stdUTC > m_dstUTC)   // northern hemisphere
-        return (utc >= m_dstUTC && utc < m_stdUTC);
-    else                            // southern hemisphere
-        return !(utc >= m_stdUTC && utc < m_dstUTC);
+    else if (lt == Gap)
+        *utc = policy == ShiftForward ? local - before : at - before;
+    else
+        *utc = policy == Later ? local - after : local - before;
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given UTC time_t is within the DST interval    *
+ * or the Standard time interval.                                       *
+ *----------------------------------------------------------------------*/
+bool Timezone::utcIsDST(time_t utc)
+{
+    STATS_CALL(StatUtcIsDST);
+    return utcIsDST_r(utc, &m_tc);
 }
 
 /*----------------------------------------------------------------------*
@@ -192,20 +402,25 @@ bool Timezone::utcIsDST(time_t utc)
  *----------------------------------------------------------------------*/
 bool Timezone::utcIsDST(struct tm* tm_utc)
 {
-    time_t utc;
-
+    STATS_CALL(StatUtcIsDSTTm);
     // Conversion from struct tm to time_t to compare times
-    utc = mk_gmtime(tm_utc);
+    return utcIsDST_r(mk_gmtime(tm_utc), &m_tc);
+}
 
+/*----------------------------------------------------------------------*
+ * Reentrant version of utcIsDST(), see toLocal_r().                    *
+ *----------------------------------------------------------------------*/
+bool Timezone::utcIsDST_r(time_t utc, TimeChanges *tc) const
+{
     // Recalculate the time change points if needed
-    if (tm_utc->tm_year != m_tm_dstUTC.tm_year) calcTimeChanges(tm_utc->tm_year);
+    checkTimeChanges(utc, tc);
 
-    if (m_stdUTC == m_dstUTC)       // daylight time not observed in this tz
+    if (tc->stdUTC == tc->dstUTC)       // daylight time not observed in this tz
         return false;
-    else if (m_stdUTC > m_dstUTC)   // northern hemisphere
-        return (utc >= m_dstUTC && utc < m_stdUTC);
-    else                            // southern hemisphere
-        return !(utc >= m_stdUTC && utc < m_dstUTC);
+    else if (tc->stdUTC > tc->dstUTC)   // northern hemisphere
+        return (utc >= tc->dstUTC && utc < tc->stdUTC);
+    else                                // southern hemisphere
+        return !(utc >= tc->stdUTC && utc < tc->dstUTC);
 }
 
 /*----------------------------------------------------------------------*
@@ -214,7 +429,7 @@ bool Timezone::utcIsDST(struct tm* tm_utc)
  *----------------------------------------------------------------------*/
 int Timezone::getUTCDSTOffset(struct tm* tm_utc)
 {
-  if (utcIsDST(tm_utc))
+  if (utcIsDST_r(mk_gmtime(tm_utc), &m_tc))
       return m_dst.offset;
   else
       return m_std.offset;
@@ -226,20 +441,8 @@ int Timezone::getUTCDSTOffset(struct tm* tm_utc)
  *----------------------------------------------------------------------*/
 bool Timezone::locIsDST(time_t local)
 {
-    struct tm tm_local;
-
-    // Conversion from time_t to struct tm to compare years
-    gmtime_r(&local, &tm_local);
-
-    // Recalculate the time change points if needed
-    if (tm_local.tm_year != m_tm_dstLoc.tm_year) calcTimeChanges(tm_local.tm_year);
-
-    if (m_stdUTC == m_dstUTC)       // daylight time not observed in this tz
-        return false;
-    else if (m_stdLoc > m_dstLoc)   // northern hemisphere
-        return (local >= m_dstLoc && local < m_stdLoc);
-    else                            // southern hemisphere
-        return !(local >= m_stdLoc && local < m_dstLoc);
+    STATS_CALL(StatLocIsDST);
+    return locIsDST_r(local, &m_tc);
 }
 
 /*----------------------------------------------------------------------*
@@ -248,20 +451,73 @@ bool Timezone::locIsDST(time_t local)
  *----------------------------------------------------------------------*/
 bool Timezone::locIsDST(struct tm* tm_local)
 {
-    time_t local;
-
+    STATS_CALL(StatLocIsDSTTm);
     // Conversion from struct tm to time_t to compare times
-    local = mk_gmtime(tm_local);
+    return locIsDST_r(mk_gmtime(tm_local), &m_tc);
+}
 
+/*----------------------------------------------------------------------*
+ * Reentrant version of locIsDST(), see toLocal_r().                    *
+ *----------------------------------------------------------------------*/
+bool Timezone::locIsDST_r(time_t local, TimeChanges *tc) const
+{
     // Recalculate the time change points if needed
-    if (tm_local->tm_year != m_tm_dstLoc.tm_year) calcTimeChanges(tm_local->tm_year);
+    checkTimeChanges(local, tc);
 
-    if (m_stdUTC == m_dstUTC)       // daylight time not observed in this tz
+    if (tc->stdUTC == tc->dstUTC)       // daylight time not observed in this tz
         return false;
-    else if (m_stdLoc > m_dstLoc)   // northern hemisphere
-        return (local >= m_dstLoc && local < m_stdLoc);
-    else                            // southern hemisphere
-        return !(local >= m_stdLoc && local < m_dstLoc);
+    else if (tc->stdLoc > tc->dstLoc)   // northern hemisphere
+        return (local >= tc->dstLoc && local < tc->stdLoc);
+    else                                // southern hemisphere
+        return !(local >= tc->stdLoc && local < tc->dstLoc);
+}
+
+/*----------------------------------------------------------------------*
+ * Find the first time change strictly after the given UTC time, and    *
+ * the time change rule it enters, e.g. to sleep until then instead of  *
+ * polling utcIsDST(). Returns false if daylight time is not observed   *
+ * in this tz.                                                          *
+ *----------------------------------------------------------------------*/
+bool Timezone::nextTransition(time_t utc, time_t *change, TimeChangeRule **tcr)
+{
+    if (!nextChange(utc, change, &m_tc)) return false;
+    if (tcr) *tcr = (*change == m_tc.dstUTC) ? &m_dst : &m_std;
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Find the last time change at or before the given UTC time, and the   *
+ * time change rule it entered. With nextTransition(), it gives the     *
+ * interval over which the current offset is valid. Returns false if    *
+ * daylight time is not observed in this tz.                            *
+ *----------------------------------------------------------------------*/
+bool Timezone::prevTransition(time_t utc, time_t *change, TimeChangeRule **tcr)
+{
+    if (!prevChange(utc, change, &m_tc)) return false;
+    if (tcr) *tcr = (*change == m_tc.dstUTC) ? &m_dst : &m_std;
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Split the UTC interval [utcBegin, utcEnd) into segments of constant  *
+ * offset from UTC, so that all the times of a segment can be           *
+ * converted with a single add. Returns the number of segments written, *
+ * at most size: if it is size, the interval may continue from the end  *
+ * of the last segment.                                                 *
+ *----------------------------------------------------------------------*/
+size_t Timezone::getSegments(time_t utcBegin, time_t utcEnd, TimeSegment *segments, size_t size)
+{
+    time_t t = utcBegin, change;
+    size_t n = 0;
+
+    while (t < utcEnd && n < size) {
+        segments[n].start = t;
+        segments[n].tcr = utcIsDST_r(t, &m_tc) ? &m_dst : &m_std;
+        segments[n].offset = segments[n].tcr->offset;
+        if (!nextChange(t, &change, &m_tc) || change > utcEnd) change = utcEnd;
+        segments[n++].end = t = change;
+    }
+    return n;
 }
 
 /*----------------------------------------------------------------------*
@@ -270,7 +526,7 @@ bool Timezone::locIsDST(struct tm* tm_local)
  *----------------------------------------------------------------------*/
 int Timezone::getLocalDSTOffset(struct tm* tm_local) {
 
-    if (locIsDST(tm_local))
+    if (locIsDST_r(mk_gmtime(tm_local), &m_tc))
         return m_dst.offset;
     else
         return m_std.offset;
@@ -280,14 +536,67 @@ int Timezone::getLocalDSTOffset(struct tm* tm_local) {
  * Calculate the DST and standard time change points for the given      *
  * year as local and UTC time_t values.                                 *
  *----------------------------------------------------------------------*/
-void Timezone::calcTimeChanges(int yr)
+void Timezone::calcTimeChanges(int yr, TimeChanges *tc) const
 {
-    m_dstLoc = toTime_t(m_dst, yr);
-    gmtime_r(&m_dstLoc, &m_tm_dstLoc);
-    m_stdLoc = toTime_t(m_std, yr);
-    m_dstUTC = m_dstLoc - m_std.offset * SECS_PER_MIN;
-    gmtime_r(&m_dstUTC, &m_tm_dstUTC);
-    m_stdUTC = m_stdLoc - m_dst.offset * SECS_PER_MIN;
+    STATS_COUNT(calcs, tc);
+    tc->dstLoc = changeTime(m_dst, yr);    // closed form, no libc calls
+    tc->stdLoc = changeTime(m_std, yr);
+    tc->dstUTC = tc->dstLoc - m_std.offset * (long) SECS_PER_MIN;
+    tc->stdUTC = tc->stdLoc - m_dst.offset * (long) SECS_PER_MIN;
+    tc->yrStart = (time_t) (daysFromCivil(yr + 1900, 1, 1) - EPOCH_DAYS) * SECS_PER_DAY;
+    tc->yrEnd = (time_t) (daysFromCivil(yr + 1901, 1, 1) - EPOCH_DAYS) * SECS_PER_DAY;
+}
+
+/*----------------------------------------------------------------------*
+ * Find the first time change after the given UTC time, in its year or  *
+ * in the next one, given in UTC. Returns false if daylight time is not *
+ * observed in this tz.                                                 *
+ *----------------------------------------------------------------------*/
+bool Timezone::nextChange(time_t utc, time_t *change, TimeChanges *tc) const
+{
+    // Recalculate the time change points if needed
+    checkTimeChanges(utc, tc);
+
+    if (tc->stdUTC == tc->dstUTC)       // daylight time not observed in this tz
+        return false;
+
+    if (utc < tc->dstUTC || utc < tc->stdUTC) {
+        if (utc < tc->dstUTC && utc < tc->stdUTC)
+            *change = tc->dstUTC < tc->stdUTC ? tc->dstUTC : tc->stdUTC;
+        else
+            *change = tc->dstUTC > tc->stdUTC ? tc->dstUTC : tc->stdUTC;
+    }
+    else {                              // first change of the next year
+        calcTimeChanges(yearOf(tc->yrEnd), tc);
+        *change = tc->dstUTC < tc->stdUTC ? tc->dstUTC : tc->stdUTC;
+    }
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Find the last time change at or before the given UTC time, in its    *
+ * year or in the previous one, given in UTC. Returns false if daylight *
+ * time is not observed in this tz.                                     *
+ *----------------------------------------------------------------------*/
+bool Timezone::prevChange(time_t utc, time_t *change, TimeChanges *tc) const
+{
+    // Recalculate the time change points if needed
+    checkTimeChanges(utc, tc);
+
+    if (tc->stdUTC == tc->dstUTC)       // daylight time not observed in this tz
+        return false;
+
+    if (utc >= tc->dstUTC || utc >= tc->stdUTC) {
+        if (utc >= tc->dstUTC && utc >= tc->stdUTC)
+            *change = tc->dstUTC > tc->stdUTC ? tc->dstUTC : tc->stdUTC;
+        else
+            *change = tc->dstUTC < tc->stdUTC ? tc->dstUTC : tc->stdUTC;
+    }
+    else {                              // last change of the previous year
+        calcTimeChanges(yearOf(tc->yrStart) - 1, tc);
+        *change = tc->dstUTC > tc->stdUTC ? tc->dstUTC : tc->stdUTC;
+    }
+    return true;
 }
 
 /*----------------------------------------------------------------------*
@@ -295,50 +604,318 @@ void Timezone::calcTimeChanges(int yr)
  *----------------------------------------------------------------------*/
 void Timezone::initTimeChanges()
 {
-    m_dstLoc = 0;
-    gmtime_r(&m_dstLoc, &m_tm_dstLoc);
-    m_stdLoc = 0;
-    m_dstUTC = 0;
-    gmtime_r(&m_dstUTC, &m_tm_dstUTC);
-    m_stdUTC = 0;
+    m_tc = TimeChanges();   // empty year bounds: no time is cached
 }
 
 /*----------------------------------------------------------------------*
- * Convert the given time change rule to a time_t value                 *
- * for the given year.                                                  *
+ * Fill the given array with the time changes from firstYear to         *
+ * lastYear included (e.g. 1970, 2100), sorted by time, to build a      *
+ * TimeChangeTable. Two changes per year are needed, only one for a     *
+ * zone that does not observe daylight time. Returns the number of      *
+ * changes written, at most size.                                       *
  *----------------------------------------------------------------------*/
-time_t Timezone::toTime_t(TimeChangeRule r, int yr)
+size_t Timezone::makeTable(TimeChange *changes, size_t size, int firstYear, int lastYear) const
 {
-    struct tm tm, tm_wday;
-    time_t t;
-    uint8_t m = r.month;     // temp copies of r.month and r.week
-    uint8_t w = r.week;
-    if (w == 0)              // is this a "Last week" rule?
-    {
-        if (++m > 11)        // yes, for "Last", go to the next month: avr-libc time.h: months in [0, 11]
-        {
-            m = 1;
-            ++yr;
+    TimeChanges tc;
+    size_t n = 0;
+
+    for (int yr = firstYear; yr <= lastYear; yr++) {
+        calcTimeChanges(yr - 1900, &tc);
+
+        if (tc.stdUTC == tc.dstUTC) {       // daylight time not observed in this tz
+            if (n < size) {
+                changes[n].utc = tc.yrStart;
+                changes[n].offset = m_std.offset;
+                changes[n++].dst = 0;
+            }
+            break;
+        }
+
+        for (uint8_t c = 0; c < 2 && n < size; c++) {
+            // northern hemisphere: dst start first, southern: std start first
+            bool dst = (tc.stdUTC > tc.dstUTC) == (c == 0);
+            changes[n].utc = dst ? tc.dstUTC : tc.stdUTC;
+            changes[n].offset = dst ? m_dst.offset : m_std.offset;
+            changes[n++].dst = dst;
+        }
+    }
+    return n;
+}
+
+/*----------------------------------------------------------------------*
+ * POSIX TZ string parsing helpers. Each one returns the end of what    *
+ * it parsed, or NULL on error.                                         *
+ *----------------------------------------------------------------------*/
+
+// Unsigned number up to max, in *n.
+static const char *parseNumber(const char *s, int max, int *n)
+{
+    if (*s < '0' || *s > '9') return NULL;
+    for (*n = 0; *s >= '0' && *s <= '9'; s++)
+        if ((*n = *n * 10 + *s - '0') > max) return NULL;
+    return s;
+}
+
+// Time zone name, alphabetic (3 chars at least) or quoted in <>,
+// truncated to the five chars of TimeChangeRule::abbrev.
+static const char *parseName(const char *s, char *abbrev)
+{
+    const char *start;
+    uint8_t len = 0;
+
+    if (*s == '<') {
+        for (start = ++s; (*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z')
+                || (*s >= '0' && *s <= '9') || *s == '+' || *s == '-'; s++)
+            if (len < 5) abbrev[len++] = *s;
+        if (s - start < 3 || *s++ != '>') return NULL;
+    }
+    else {
+        for (start = s; (*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z'); s++)
+            if (len < 5) abbrev[len++] = *s;
+        if (s - start < 3) return NULL;
+    }
+    abbrev[len] = 0;
+    return s;
+}
+
+// Signed time [+-]hh[:mm[:00]], hh up to maxHour, in minutes. Seconds
+// are accepted only if zero, since rules have minute resolution.
+static const char *parseTime(const char *s, int maxHour, int *minutes)
+{
+    int sign = 1, hh, mm = 0, ss = 0;
+
+    if (*s == '+' || *s == '-') sign = (*s++ == '-') ? -1 : 1;
+    if (!(s = parseNumber(s, maxHour, &hh))) return NULL;
+    if (*s == ':') {
+        if (!(s = parseNumber(s + 1, 59, &mm))) return NULL;
+        if (*s == ':' && (!(s = parseNumber(s + 1, 59, &ss)) || ss != 0)) return NULL;
+    }
+    *minutes = sign * (hh * 60 + mm);
+    return s;
+}
+
+// Date and time of a rule: Jn, n or Mm.w.d, then [/time], 02:00 by default.
+static const char *parseRule(const char *s, TimeChangeRule *r)
+{
+    int n, w, d, minutes = 120;
+
+    if (*s == 'J') {
+        if (!(s = parseNumber(s + 1, 365, &n)) || n < 1) return NULL;
+        r->week = JulianDay;
+        r->yday = n;
+    }
+    else if (*s == 'M') {
+        if (!(s = parseNumber(s + 1, 12, &n)) || n < 1 || *s != '.') return NULL;
+        if (!(s = parseNumber(s + 1, 5, &w)) || w < 1 || *s != '.') return NULL;
+        if (!(s = parseNumber(s + 1, 6, &d))) return NULL;
+        r->week = (w == 5) ? Last : w;  // POSIX: week 5 is the last one
+        r->dow = d;
+        r->month = n - 1;
+    }
+    else {
+        if (!(s = parseNumber(s, 365, &n))) return NULL;
+        r->week = YearDay;
+        r->yday = n;
+    }
+    if (*s == '/' && !(s = parseTime(s + 1, 167, &minutes))) return NULL;
+    r->hour = minutes > 0 ? minutes / 60 : 0;
+    r->minute = minutes - r->hour * 60;
+    return s;
+}
+
+// Report a parse error at the given position.
+static bool parseError(const char *at, const char **end)
+{
+    if (end) *end = at;
+    return false;
+}
+
+/*----------------------------------------------------------------------*
+ * Parse a POSIX TZ string, e.g. CET-1CEST,M3.5.0,M10.5.0/3, into the   *
+ * daylight and standard time rules, without any heap allocation.       *
+ * Rule dates can be Mm.w.d, Jn or n, with times in minutes, negative   *
+ * or beyond 24h. If the daylight time rules are omitted the US ones    *
+ * are used; for a zone without daylight time, dst is a copy of std.    *
+ * Returns false on error; if end is not NULL, it points where the      *
+ * parsing stopped: after the TZ string, or at the wrong token.         *
+ *----------------------------------------------------------------------*/
+bool Timezone::parseRules(const char *tz, TimeChangeRule *dst, TimeChangeRule *std, const char **end)
+{
+    const char *s, *token;
+    int offset;
+
+    memset((void*) std, 0, sizeof(*std));
+    if (!(s = parseName(token = tz, std->abbrev)) || !(s = parseTime(token = s, 24, &offset)))
+        return parseError(token, end);
+    std->offset = -offset;              // POSIX offsets are west of UTC
+    *dst = *std;
+
+    if (*s == '<' || (*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z')) {
+        if (!(s = parseName(token = s, dst->abbrev))) return parseError(token, end);
+        dst->offset = std->offset + 60; // one hour ahead by default
+        if (*s == '+' || *s == '-' || (*s >= '0' && *s <= '9')) {
+            if (!(s = parseTime(token = s, 24, &offset))) return parseError(token, end);
+            dst->offset = -offset;
         }
-        w = 1;               // and treat as first week of next month, subtract 7 days later
+
+        if (*s == ',') {
+            if (!(s = parseRule(token = s + 1, dst)) || *s != ',' || !(s = parseRule(token = s + 1, std)))
+                return parseError(token, end);
+        }
+        else {
+            parseRule("M3.2.0", dst);   // US rules by default
+            parseRule("M11.1.0", std);
+        }
+    }
+    if (end) *end = s;
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Set the daylight and standard time rules from a POSIX TZ string,     *
+ * see parseRules(). Returns false on error, leaving the rules as they  *
+ * were; the whole string must be parsed.                               *
+ *----------------------------------------------------------------------*/
+bool Timezone::setRules(const char *tz, const char **end)
+{
+    TimeChangeRule dst, std;
+    const char *e;
+    bool ok = parseRules(tz, &dst, &std, &e) && *e == 0;
+
+    if (end) *end = e;
+    if (ok) setRules(dst, std);
+    return ok;
+}
+
+// two digits of each number 0-99, in flash on avr
+static const char DIGITS[201] PROGMEM =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+/*----------------------------------------------------------------------*
+ * Write the two digits of the given number 0-99.                       *
+ *----------------------------------------------------------------------*/
+static char *formatDigits(char *p, uint8_t n)
+{
+#ifdef __AVR__
+    memcpy_P(p, DIGITS + 2 * n, 2);
+#else
+    memcpy(p, DIGITS + 2 * n, 2);
+#endif
+    return p + 2;
+}
+
+/*----------------------------------------------------------------------*
+ * Split the given time in days since 1970-01-01 and seconds of day.    *
+ *----------------------------------------------------------------------*/
+static void splitTime(time_t t, long *days, long *secs)
+{
+    *days = Timezone::daysOf(t);
+    *secs = (long) (t - (time_t) (*days - EPOCH_DAYS) * SECS_PER_DAY);
+}
+
+/*----------------------------------------------------------------------*
+ * Write the date "YYYY-MM-DD" of the given days since 1970-01-01.      *
+ * Returns false if the year is not in 0-9999.                          *
+ *----------------------------------------------------------------------*/
+static bool formatDate(char *p, long z)
+{
+    CivilDate d = Timezone::civilFromDays(z);
+
+    if (d.year < 0 || d.year > 9999) return false;
+    p = formatDigits(p, d.year / 100);
+    p = formatDigits(p, d.year % 100);
+    *p++ = '-';
+    p = formatDigits(p, d.month);
+    *p++ = '-';
+    formatDigits(p, d.day);
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Write the part of the formatted time after the date, from the given  *
+ * seconds of day. Returns the position of the ending NUL.              *
+ *----------------------------------------------------------------------*/
+static char *formatTime(char *p, long secs, int offset, const char *abbrev, timeFormat_t fmt)
+{
+    *p++ = fmt == ISOAbbrev ? ' ' : 'T';
+    p = formatDigits(p, secs / SECS_PER_HOUR);
+    *p++ = ':';
+    p = formatDigits(p, secs / SECS_PER_MIN % 60);
+    *p++ = ':';
+    p = formatDigits(p, secs % 60);
+    if (fmt != ISOAbbrev) {
+        *p++ = offset < 0 ? '-' : '+';
+        if (offset < 0) offset = -offset;
+        p = formatDigits(p, offset / 60);
+        *p++ = ':';
+        p = formatDigits(p, offset % 60);
+    }
+    if (fmt != RFC3339) {
+        *p++ = ' ';
+        for (uint8_t i = 0; i < 5 && abbrev[i]; i++) *p++ = abbrev[i];
+    }
+    *p = 0;
+    return p;
+}
+
+/*----------------------------------------------------------------------*
+ * Write the given local time, with its offset from UTC in minutes and  *
+ * its time zone abbreviation, in the given format into buf, of at      *
+ * least TZ_FORMAT_SIZE chars, without locale nor heap (abbreviations   *
+ * are cut to five chars). Returns the length of the string, or 0 if    *
+ * the year is not in 0-9999 (buf is then an empty string).             *
+ *----------------------------------------------------------------------*/
+size_t Timezone::formatLocal(time_t local, int offset, const char *abbrev, char *buf, timeFormat_t fmt)
+{
+    long days, secs;
+
+    splitTime(local, &days, &secs);
+    if (!formatDate(buf, days)) {
+        *buf = 0;
+        return 0;
     }
+    return formatTime(buf + 10, secs, offset, abbrev, fmt) - buf;
+}
 
-    tm.tm_hour = r.hour;
-    tm.tm_min= 0;
-    tm.tm_sec = 0;
-    tm.tm_mday = 1;
-    tm.tm_mon = m;
-    tm.tm_year = yr;         // avr-libc time.h: years since 1900 + y2k epoch difference (2000 - 1970)
+/*----------------------------------------------------------------------*
+ * Convert the given UTC time to local time and write it into buf, see  *
+ * formatLocal().                                                       *
+ *----------------------------------------------------------------------*/
+size_t Timezone::format(time_t utc, char *buf, timeFormat_t fmt)
+{
+    const TimeChangeRule *tcr;
+    time_t local = toLocal_r(utc, &m_tc, &tcr);
 
-    t = mk_gmtime(&tm);      // calculate first day of the month, or for "Last" rules, first day of the next month
+    return formatLocal(local, tcr->offset, tcr->abbrev, buf, fmt);
+}
 
-    gmtime_r(&t, &tm_wday);  // conversion from time_t to struct tm to have week day
+/*----------------------------------------------------------------------*
+ * Convert an array of n UTC times to local times and write them into   *
+ * the n buffers of buf, see formatLocal(). The date of an element on   *
+ * the same day as the previous one is copied from it.                  *
+ *----------------------------------------------------------------------*/
+void Timezone::format(const time_t *utc, char (*buf)[TZ_FORMAT_SIZE], size_t n, timeFormat_t fmt)
+{
+    const TimeChangeRule *tcr;
+    long days, secs, prevDays = 0;
+    bool prev = false;          // date of the previous element valid
 
-    // add offset from the first of the month to r.dow, and offset for the given week: weekday in [0, 6]
-    t += ((r.dow - tm_wday.tm_wday + 7) % 7 + (w - 1) * 7) * SECS_PER_DAY;
-    // back up a week if this is a "Last" rule
-    if (r.week == 0) t -= 7 * SECS_PER_DAY;
-    return t;
+    for (size_t i = 0; i < n; i++) {
+        splitTime(toLocal_r(utc[i], &m_tc, &tcr), &days, &secs);
+        if (prev && days == prevDays)
+            memcpy(buf[i], buf[i - 1], 10);
+        else if (!formatDate(buf[i], days)) {
+            buf[i][0] = 0;
+            prev = false;
+            continue;
+        }
+        formatTime(buf[i] + 10, secs, tcr->offset, tcr->abbrev, fmt);
+        prevDays = days;
+        prev = true;
+    }
 }
 
 /*----------------------------------------------------------------------*
@@ -352,15 +929,44 @@ void Timezone::setRules(TimeChangeRule dstStart, TimeChangeRule stdStart)
 }
 
 #ifdef __AVR__
+#define EEPROM_RULE 12      // size of a rule in EEPROM: abbrev, week, dow, month, hour, offset
+
+/*----------------------------------------------------------------------*
+ * Read or write one rule in EEPROM, field by field, in the layout of   *
+ * the TimeChangeRule struct before minute and yday were added, so that *
+ * rules stored by older versions of the library keep working. minute   *
+ * and yday are not stored, they read as 0.                             *
+ *----------------------------------------------------------------------*/
+static void eepromReadRule(int address, TimeChangeRule *r)
+{
+    eeprom_read_block((void *) r->abbrev, (void *) address, sizeof(r->abbrev));
+    r->week = eeprom_read_byte((uint8_t *) address + 6);
+    r->dow = eeprom_read_byte((uint8_t *) address + 7);
+    r->month = eeprom_read_byte((uint8_t *) address + 8);
+    r->hour = eeprom_read_byte((uint8_t *) address + 9);
+    r->offset = (int) eeprom_read_word((uint16_t *) (address + 10));
+    r->minute = 0;
+    r->yday = 0;
+}
+
+static void eepromWriteRule(int address, const TimeChangeRule *r)
+{
+    eeprom_write_block((void *) r->abbrev, (void *) address, sizeof(r->abbrev));
+    eeprom_write_byte((uint8_t *) address + 6, r->week);
+    eeprom_write_byte((uint8_t *) address + 7, r->dow);
+    eeprom_write_byte((uint8_t *) address + 8, r->month);
+    eeprom_write_byte((uint8_t *) address + 9, r->hour);
+    eeprom_write_word((uint16_t *) (address + 10), (uint16_t) r->offset);
+}
+
 /*----------------------------------------------------------------------*
  * Read the daylight and standard time rules from EEPROM at             *
  * the given address.                                                   *
  *----------------------------------------------------------------------*/
 void Timezone::readRules(int address)
 {
-    eeprom_read_block((void *) &m_dst, (void *) address, sizeof(m_dst));
-    address += sizeof(m_dst);
-    eeprom_read_block((void *) &m_std, (void *) address, sizeof(m_std));
+    eepromReadRule(address, &m_dst);
+    eepromReadRule(address + EEPROM_RULE, &m_std);
     initTimeChanges();  // force calcTimeChanges() at next conversion call
 }
 
@@ -370,8 +976,323 @@ void Timezone::readRules(int address)
  *----------------------------------------------------------------------*/
 void Timezone::writeRules(int address)
 {
-    eeprom_write_block((void *) &m_dst, (void *) address, sizeof(m_dst));
-    address += sizeof(m_dst);
-    eeprom_write_block((void *) &m_std, (void *) address, sizeof(m_std));
+    eepromWriteRule(address, &m_dst);
+    eepromWriteRule(address + EEPROM_RULE, &m_std);
+}
+#endif
+
+#ifdef TZ_STATS
+/*----------------------------------------------------------------------*
+ * Statistics of the conversions since the object was created or the    *
+ * last resetStats() call.                                              *
+ *----------------------------------------------------------------------*/
+const TimezoneStats &Timezone::getStats() const
+{
+    return m_stats;
+}
+
+void Timezone::resetStats()
+{
+    memset((void *) &m_stats, 0, sizeof(m_stats));
+}
+
+/*----------------------------------------------------------------------*
+ * Pass the number of calls of each called function to the given        *
+ * function, e.g. to print it, with bin -1 and, with TZ_STATS_CYCLES,   *
+ * the non empty bins of its histogram of cycles. The functions are     *
+ * given as tzCall_t, the caller names them: no table of names in RAM.  *
+ *----------------------------------------------------------------------*/
+void Timezone::dumpStats(void (*out)(tzCall_t call, int bin, uint32_t count)) const
+{
+    for (uint8_t c = 0; c < TZ_STATS_CALLS; c++) {
+        if (!m_stats.calls[c]) continue;
+        out((tzCall_t) c, -1, m_stats.calls[c]);
+#ifdef TZ_STATS_CYCLES
+        for (uint8_t b = 0; b < TZ_STATS_BINS; b++)
+            if (m_stats.cycles[c][b]) out((tzCall_t) c, b, m_stats.cycles[c][b]);
+#endif
+    }
+}
+#endif
+
+// layout of the serialized rules
+#define RULES_HEADER    6       // "TZ", version, reserved, number of time changes (16 bit)
+#define RULES_RULE      16      // abbrev[6], week, dow, month, hour, offset, minute, yday (16 bit)
+#define RULES_CHANGE    11      // utc (64 bit, since 1970-01-01), offset (16 bit), dst
+
+/*----------------------------------------------------------------------*
+ * Little endian integers, written into a buffer or read from the given *
+ * storage.                                                             *
+ *----------------------------------------------------------------------*/
+static uint8_t *putLE(uint8_t *p, int64_t n, uint8_t size)
+{
+    for (uint8_t i = 0; i < size; i++, n >>= 8) *p++ = (uint8_t) n;
+    return p;
 }
+
+static uint8_t readByte(const uint8_t *p, storage_t from)
+{
+#ifdef __AVR__
+    if (from == Flash) return pgm_read_byte(p);
+    if (from == Eeprom) return eeprom_read_byte(p);
+#else
+    (void) from;
 #endif
+    return *p;
+}
+
+static uint64_t readLE(const uint8_t *p, uint8_t size, storage_t from)
+{
+    uint64_t n = 0;
+
+    while (size--) n = n << 8 | readByte(p + size, from);
+    return n;
+}
+
+/*----------------------------------------------------------------------*
+ * Fletcher-16 checksum of the given bytes.                             *
+ *----------------------------------------------------------------------*/
+static uint16_t checksum(const uint8_t *p, size_t size, storage_t from)
+{
+    uint16_t a = 0, b = 0;
+
+    while (size--) {
+        a = (a + readByte(p++, from)) % 255;
+        b = (b + a) % 255;
+    }
+    return b << 8 | a;
+}
+
+static uint8_t *putRule(uint8_t *p, const TimeChangeRule &r)
+{
+    memcpy(p, r.abbrev, sizeof(r.abbrev));
+    p += sizeof(r.abbrev);
+    *p++ = r.week;
+    *p++ = r.dow;
+    *p++ = r.month;
+    *p++ = r.hour;
+    p = putLE(p, r.offset, 2);
+    p = putLE(p, r.minute, 2);
+    return putLE(p, r.yday, 2);
+}
+
+static void readRule(const uint8_t *p, TimeChangeRule *r, storage_t from)
+{
+    for (uint8_t i = 0; i < sizeof(r->abbrev); i++) r->abbrev[i] = readByte(p++, from);
+    r->abbrev[sizeof(r->abbrev) - 1] = 0;
+    r->week = readByte(p++, from);
+    r->dow = readByte(p++, from);
+    r->month = readByte(p++, from);
+    r->hour = readByte(p++, from);
+    r->offset = (int16_t) readLE(p, 2, from);
+    r->minute = (int16_t) readLE(p + 2, 2, from);
+    r->yday = (uint16_t) readLE(p + 4, 2, from);
+}
+
+/*----------------------------------------------------------------------*
+ * Serialize the daylight and standard time rules into buf, with the    *
+ * given count time changes if any (e.g. from makeTable()), in a packed *
+ * little endian format that is the same on every platform (see         *
+ * TZ_RULES_SIZE). Returns the number of bytes written, or 0 if buf is  *
+ * too small. The bytes can then be stored in EEPROM, flash or a file.  *
+ *----------------------------------------------------------------------*/
+size_t Timezone::saveRules(uint8_t *buf, size_t size, const TimeChange *changes, size_t count) const
+{
+    uint8_t *p = buf;
+
+    // count bounded before TZ_RULES_SIZE(count), that wraps in a 16 bit size_t
+    if (count > 0xFFFF || size < TZ_RULES_SIZE(0) || count > (size - TZ_RULES_SIZE(0)) / RULES_CHANGE) return 0;
+
+    *p++ = 'T';
+    *p++ = 'Z';
+    *p++ = TZ_RULES_VERSION;
+    *p++ = 0;
+    p = putLE(p, count, 2);
+    p = putRule(p, m_dst);
+    p = putRule(p, m_std);
+    for (size_t i = 0; i < count; i++) {
+        p = putLE(p, (int64_t) changes[i].utc + EPOCH_DAYS * SECS_PER_DAY, 8);
+        p = putLE(p, changes[i].offset, 2);
+        *p++ = changes[i].dst;
+    }
+    p = putLE(p, checksum(buf, p - buf, Memory), 2);
+    return p - buf;
+}
+
+/*----------------------------------------------------------------------*
+ * Load the rules serialized by saveRules() from the given storage:     *
+ * RAM, or on avr flash (PROGMEM) or EEPROM (buf is then the address).  *
+ * If changes is not NULL, the time changes are loaded as well: count   *
+ * gives the size of the array, and returns the number of time changes  *
+ * loaded. Returns false, without changing the rules, if the data is    *
+ * not valid (size, version or checksum) or the time changes do not fit *
+ * the array.                                                           *
+ *----------------------------------------------------------------------*/
+bool Timezone::loadRules(const uint8_t *buf, size_t size, storage_t from, TimeChange *changes, size_t *count)
+{
+    size_t n;
+
+    if (size < TZ_RULES_SIZE(0) || readByte(buf, from) != 'T' || readByte(buf + 1, from) != 'Z'
+        || readByte(buf + 2, from) != TZ_RULES_VERSION)
+        return false;
+    n = readLE(buf + 4, 2, from);
+    if (n > (size - TZ_RULES_SIZE(0)) / RULES_CHANGE || (changes && n > *count)
+        || checksum(buf, TZ_RULES_SIZE(n) - 2, from) != readLE(buf + TZ_RULES_SIZE(n) - 2, 2, from))
+        return false;
+
+    readRule(buf + RULES_HEADER, &m_dst, from);
+    readRule(buf + RULES_HEADER + RULES_RULE, &m_std, from);
+    initTimeChanges();  // force calcTimeChanges() at next conversion call
+
+    if (changes) {
+        buf += RULES_HEADER + 2 * RULES_RULE;
+        for (size_t i = 0; i < n; i++, buf += RULES_CHANGE) {
+            changes[i].utc = (int64_t) readLE(buf, 8, from) - EPOCH_DAYS * SECS_PER_DAY;
+            changes[i].offset = (int16_t) readLE(buf + 8, 2, from);
+            changes[i].dst = readByte(buf + 10, from);
+        }
+        *count = n;
+    }
+    return true;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+/*----------------------------------------------------------------------*
+ * Load the rules serialized by saveRules() from the given file, see    *
+ * loadRules() above.                                                   *
+ *----------------------------------------------------------------------*/
+bool Timezone::loadRules(const char *path, TimeChange *changes, size_t *count)
+{
+    struct stat st;
+    void *map = MAP_FAILED;
+    bool ok;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) return false;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    ok = loadRules((const uint8_t *) map, st.st_size, Memory, changes, count);
+    munmap(map, st.st_size);
+    return ok;
+}
+#endif
+
+/*----------------------------------------------------------------------*
+ * Create a TimeChangeTable from the given array of time changes,       *
+ * sorted by time (see Timezone::makeTable). If progmem is true, the    *
+ * array is read from flash (avr only, ignored elsewhere). Conversions  *
+ * are only valid within the span of years covered by the table.        *
+ *----------------------------------------------------------------------*/
+TimeChangeTable::TimeChangeTable(const TimeChange *changes, size_t count, bool progmem)
+    : m_changes(changes), m_count(count), m_progmem(progmem)
+{
+}
+
+/*----------------------------------------------------------------------*
+ * Convert the given UTC time to local time, standard or                *
+ * daylight time, as appropriate.                                       *
+ *----------------------------------------------------------------------*/
+time_t TimeChangeTable::toLocal(time_t utc) const
+{
+    TimeChange tc;
+
+    findUTC(utc, &tc);
+    return utc + tc.offset * (long) SECS_PER_MIN;
+}
+
+/*----------------------------------------------------------------------*
+ * Convert the given local time to UTC time. Same caveats as            *
+ * Timezone::toUTC() for the local times during a transition interval.  *
+ *----------------------------------------------------------------------*/
+time_t TimeChangeTable::toUTC(time_t local) const
+{
+    TimeChange tc;
+
+    findLoc(local, &tc);
+    return local - tc.offset * (long) SECS_PER_MIN;
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given UTC time_t is within the DST interval    *
+ * or the Standard time interval.                                       *
+ *----------------------------------------------------------------------*/
+bool TimeChangeTable::utcIsDST(time_t utc) const
+{
+    TimeChange tc;
+
+    findUTC(utc, &tc);
+    return tc.dst;
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given Local time_t is within the DST interval  *
+ * or the Standard time interval.                                       *
+ *----------------------------------------------------------------------*/
+bool TimeChangeTable::locIsDST(time_t local) const
+{
+    TimeChange tc;
+
+    findLoc(local, &tc);
+    return tc.dst;
+}
+
+/*----------------------------------------------------------------------*
+ * Copy the i-th time change of the table, from RAM or flash.           *
+ *----------------------------------------------------------------------*/
+void TimeChangeTable::read(size_t i, TimeChange *tc) const
+{
+#ifdef __AVR__
+    if (m_progmem) {
+        memcpy_P((void*) tc, (const void*) &m_changes[i], sizeof(*tc));
+        return;
+    }
+#endif
+    *tc = m_changes[i];
+}
+
+/*----------------------------------------------------------------------*
+ * Find the time change in effect at the given UTC time. Before the     *
+ * first change of the table, the time in effect is the one of the      *
+ * second change (time changes alternate).                              *
+ *----------------------------------------------------------------------*/
+void TimeChangeTable::findUTC(time_t utc, TimeChange *tc) const
+{
+    size_t lo = 0, hi = m_count, mid;
+
+    // binary search of the first change after utc
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        read(mid, tc);
+        if (tc->utc <= utc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    read(lo > 0 ? lo - 1 : (m_count > 1 ? 1 : 0), tc);
+}
+
+/*----------------------------------------------------------------------*
+ * Find the time change in effect at the given local time. A change     *
+ * happens, in local time, at its UTC time plus the offset in effect    *
+ * before the change, i.e. the offset of the previous change.           *
+ *----------------------------------------------------------------------*/
+void TimeChangeTable::findLoc(time_t local, TimeChange *tc) const
+{
+    size_t lo = 0, hi = m_count, mid;
+    TimeChange prev;
+
+    // binary search of the first change after local
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        read(mid, tc);
+        read(mid > 0 ? mid - 1 : (m_count > 1 ? 1 : 0), &prev);
+        if (tc->utc + prev.offset * (long) SECS_PER_MIN <= local)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    read(lo > 0 ? lo - 1 : (m_count > 1 ? 1 : 0), tc);
+}
@@ -34,21 +34,133 @@
 #define SECS_PER_HOUR   3600
 #define SECS_PER_DAY    86400
 
+// Uncomment to count the conversions and the time change cache hits in
+// each Timezone (see Timezone::getStats), and with TZ_STATS_CYCLES to keep
+// histograms of their duration in cycles, read with TZ_CYCLES() (rdtsc on
+// x86, to be defined elsewhere). Without them, the statistics cost nothing.
+//#define TZ_STATS
+//#define TZ_STATS_CYCLES
+
+#ifdef __AVR__
+    #define EPOCH_DAYS  10957L      // avr-libc time.h: time_t counts from 2000-01-01 (y2k epoch)
+#else
+    #define EPOCH_DAYS  0L          // time_t counts from 1970-01-01
+#endif
+
 // convenient constants for TimeChangeRules
-enum week_t {Last, First, Second, Third, Fourth}; 
+enum week_t {Last, First, Second, Third, Fourth, JulianDay, YearDay};   // JulianDay, YearDay: day of year rules (POSIX Jn, n)
 enum dow_t {Sun, Mon, Tue, Wed, Thu, Fri, Sat};					            // avr-libc time.h: sunday is 0
 enum month_t {Jan, Feb, Mar, Apr, May, Jun, Jul, Aug, Sep, Oct, Nov, Dec};	// avr-libc time.h: months in [0, 11]
 
+#ifdef TZ_STATS
+// counted functions, the reentrant *_r functions are not counted
+enum tzCall_t {StatToLocal, StatToLocalTcr, StatToLocalTm, StatToLocalTmTm, StatToLocalN,
+    StatToUTC, StatToUTCN, StatToUTCPolicy, StatUtcIsDST, StatUtcIsDSTTm, StatLocIsDST, StatLocIsDSTTm,
+    TZ_STATS_CALLS};
+#define TZ_STATS_BINS   24      // bin i counts the calls of [2^i, 2^(i+1)) cycles, the last one above
+
+// statistics of a Timezone. Only the functions using the cache of the
+// object count, the ones that are not thread safe anyway: the const
+// functions (reentrant *_r, makeTable() etc.) never write them.
+struct TimezoneStats
+{
+    uint32_t hits;          // lookups of the time change points found in the cache of the object
+    uint32_t misses;        // lookups that recalculated them
+    uint32_t calcs;         // recalculations of the cache of the object, including the transition queries
+    uint32_t calls[TZ_STATS_CALLS];
+#ifdef TZ_STATS_CYCLES
+    uint32_t cycles[TZ_STATS_CALLS][TZ_STATS_BINS];
+#endif
+};
+#endif
+
+// formats of Timezone::format
+enum timeFormat_t {ISOAbbrev, RFC3339, RFC3339Abbrev};      // "2024-03-31 03:00:00 CEST", "2024-03-31T03:00:00+02:00", both
+#define TZ_FORMAT_SIZE  32      // size of the buffer of a formatted time, with the ending NUL
+
+// serialized rules (see Timezone::saveRules): little endian, version, rules,
+// optional time changes and checksum; the same bytes on every platform
+#define TZ_RULES_VERSION    1
+#define TZ_RULES_SIZE(n)    (40 + 11 * (n))     // size with n time changes
+enum storage_t {Memory, Flash, Eeprom};         // where they are loaded from (Flash, Eeprom: avr only)
+
+// local times around a time change (see Timezone::toUTC with a policy)
+enum localTime_t {Valid, Gap, Fold};                        // Gap: skipped, Fold: occurs twice
+enum localPolicy_t {Earlier, Later, Reject, ShiftForward};  // how to convert them to UTC
+
 // structure to describe rules for when daylight/summer time begins,
 // or when standard time begins.
 struct TimeChangeRule
 {
     char abbrev[6];    // five chars max
-    uint8_t week;      // First, Second, Third, Fourth, or Last week of the month
+    uint8_t week;      // First, Second, Third, Fourth, or Last week of the month, or JulianDay, YearDay
     uint8_t dow;       // day of week, 0=Sun, 2=Mon, ... 6=Sat
     uint8_t month;     // 0=Jan, 1=Feb, ... 11=Dec
     uint8_t hour;      // 0-23
     int offset;        // offset from UTC in minutes
+    int16_t minute;    // minutes added to hour, may be negative (POSIX rules), usually 0
+    uint16_t yday;     // day of year, JulianDay: 1-365 never counting Feb 29, YearDay: 0-365
+};
+
+// time change points of a single year, as cached by the conversion
+// functions. The reentrant *_r functions take it from the caller.
+struct TimeChanges
+{
+    TimeChanges() : dstUTC(0), stdUTC(0), dstLoc(0), stdLoc(0), yrStart(0), yrEnd(0) {}
+    time_t dstUTC;     // dst start for given/current year, given in UTC
+    time_t stdUTC;     // std time start for given/current year, given in UTC
+    time_t dstLoc;     // dst start for given/current year, given in local time
+    time_t stdLoc;     // std time start for given/current year, given in local time
+    time_t yrStart;    // [yrStart, yrEnd) bounds of the given/current year,
+    time_t yrEnd;      // valid both for UTC and local times
+};
+
+// structure to describe a single time change, as stored in a
+// precomputed table of time changes (see Timezone::makeTable).
+struct TimeChange
+{
+    time_t utc;        // instant of the change, given in UTC
+    int offset;        // offset from UTC in minutes, from utc on
+    uint8_t dst;       // 1 if daylight time starts at utc, 0 for standard time
+};
+
+// structure to describe a segment of time with a constant offset
+// from UTC (see Timezone::getSegments).
+struct TimeSegment
+{
+    time_t start;          // start of the segment, UTC, included
+    time_t end;            // end of the segment, UTC, excluded
+    int offset;            // offset from UTC in minutes
+    TimeChangeRule *tcr;   // rule in effect, daylight or standard time
+};
+
+// civil date, as given by Timezone::civilFromDays
+struct CivilDate
+{
+    int year;          // e.g. 2018
+    uint8_t month;     // 1=Jan, ... 12=Dec
+    uint8_t day;       // 1-31
+};
+
+// sorted table of time changes covering a span of years, in RAM or
+// in flash (PROGMEM, avr only). Lookups are binary searches and never
+// modify the table, nor the object.
+class TimeChangeTable
+{
+    public:
+        TimeChangeTable(const TimeChange *changes, size_t count, bool progmem = false);
+        time_t toLocal(time_t utc) const;
+        time_t toUTC(time_t local) const;
+        bool utcIsDST(time_t utc) const;
+        bool locIsDST(time_t local) const;
+
+    private:
+        void read(size_t i, TimeChange *tc) const;
+        void findUTC(time_t utc, TimeChange *tc) const;
+        void findLoc(time_t local, TimeChange *tc) const;
+        const TimeChange *m_changes;
+        size_t m_count;
+        bool m_progmem;
 };
         
 class Timezone
@@ -56,33 +168,158 @@ class Timezone
     public:
         Timezone(TimeChangeRule dstStart, TimeChangeRule stdStart);
         Timezone(TimeChangeRule stdTime);
+#ifdef __AVR__
         Timezone(int address);
+#endif
         time_t toLocal(time_t utc);
         time_t toLocal(time_t utc, TimeChangeRule **tcr);
         time_t toLocal(time_t utc, struct tm *tm_local, TimeChangeRule **tcr);
         time_t toLocal(struct tm *tm_utc, struct tm *tm_local, TimeChangeRule **tcr);
+        void   toLocal(const time_t *utc, time_t *local, size_t n);
         time_t toUTC(time_t local);
+        void   toUTC(const time_t *local, time_t *utc, size_t n);
+        bool   toUTC(time_t local, time_t *utc, localPolicy_t policy, localTime_t *type = NULL);
         bool utcIsDST(time_t utc);
         bool utcIsDST(struct tm *tm_utc);
         bool locIsDST(time_t local);
         bool locIsDST(struct tm *tm_local);
+        time_t toLocal_r(time_t utc, TimeChanges *tc, const TimeChangeRule **tcr = NULL) const;
+        time_t toUTC_r(time_t local, TimeChanges *tc) const;
+        bool toUTC_r(time_t local, time_t *utc, localPolicy_t policy, TimeChanges *tc, localTime_t *type = NULL) const;
+        bool utcIsDST_r(time_t utc, TimeChanges *tc) const;
+        bool locIsDST_r(time_t local, TimeChanges *tc) const;
+        bool nextTransition(time_t utc, time_t *change, TimeChangeRule **tcr = NULL);
+        bool prevTransition(time_t utc, time_t *change, TimeChangeRule **tcr = NULL);
+        size_t getSegments(time_t utcBegin, time_t utcEnd, TimeSegment *segments, size_t size);
+        size_t format(time_t utc, char *buf, timeFormat_t fmt = ISOAbbrev);
+        void   format(const time_t *utc, char (*buf)[TZ_FORMAT_SIZE], size_t n, timeFormat_t fmt = ISOAbbrev);
+        static size_t formatLocal(time_t local, int offset, const char *abbrev, char *buf, timeFormat_t fmt = ISOAbbrev);
         int  getLocalDSTOffset(struct tm* tm_local);
         int  getUTCDSTOffset(struct tm* tm_utc);
         void setRules(TimeChangeRule dstStart, TimeChangeRule stdStart);
+        bool setRules(const char *tz, const char **end = NULL);
+        static bool parseRules(const char *tz, TimeChangeRule *dst, TimeChangeRule *std, const char **end = NULL);
+#ifdef __AVR__
         void readRules(int address);
         void writeRules(int address);
+#endif
+        size_t saveRules(uint8_t *buf, size_t size, const TimeChange *changes = NULL, size_t count = 0) const;
+        bool loadRules(const uint8_t *buf, size_t size, storage_t from = Memory, TimeChange *changes = NULL, size_t *count = NULL);
+#if defined(__unix__) || defined(__APPLE__)
+        bool loadRules(const char *path, TimeChange *changes = NULL, size_t *count = NULL);
+#endif
+        size_t makeTable(TimeChange *changes, size_t size, int firstYear, int lastYear) const;
+#ifdef TZ_STATS
+        const TimezoneStats &getStats() const;
+        void resetStats();
+        void dumpStats(void (*out)(tzCall_t call, int bin, uint32_t count)) const;
+#endif
+
+        // Integer only calendar arithmetic, from H. Hinnant's "chrono-compatible
+        // low-level date algorithms", usable in constant expressions (C++11).
+
+        // number of days from 1970-01-01 to the given civil date, month in [1, 12]
+        static constexpr long daysFromCivil(int y, int m, int d)
+        {
+            return daysFromMar1(y - (m <= 2), (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1);
+        }
+
+        // civil date of the given number of days from 1970-01-01
+        static constexpr CivilDate civilFromDays(long z)
+        {
+            return civilFromEra(floorDiv(z + 719468L, 146097L), z + 719468L - floorDiv(z + 719468L, 146097L) * 146097L);
+        }
+
+        // civil year of the given number of days from 1970-01-01
+        static constexpr int yearFromDays(long z)
+        {
+            return civilFromDays(z).year;
+        }
+
+        // number of days from 1970-01-01 of the given time_t, rounded down
+        static constexpr long daysOf(time_t t)
+        {
+            return (long) (t / SECS_PER_DAY) - (t % SECS_PER_DAY < 0) + EPOCH_DAYS;
+        }
+
+        // year of the given time_t, as struct tm tm_year (years since 1900)
+        static constexpr int yearOf(time_t t)
+        {
+            return yearFromDays(daysOf(t)) - 1900;
+        }
+
+        // day of the week of the given number of days from 1970-01-01, 0=Sun
+        static constexpr int weekday(long z)
+        {
+            return (z % 7 + 11) % 7;
+        }
+
+        static constexpr bool isLeap(int y)
+        {
+            return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+        }
+
+        // time_t of the given time change rule for the given year (years since 1900)
+        static constexpr time_t changeTime(const TimeChangeRule &r, int yr)
+        {
+            return (time_t) (changeDay(r, yr + 1900) - EPOCH_DAYS) * SECS_PER_DAY
+                + r.hour * (long) SECS_PER_HOUR + r.minute * (long) SECS_PER_MIN;
+        }
 
     private:
-        void calcTimeChanges(int yr);
+        template <uint8_t N> friend class TimezoneSet;
+        friend class TimezoneBulk;
+
+        static constexpr long floorDiv(long a, long b)
+        {
+            return (a >= 0 ? a : a - b + 1) / b;
+        }
+        static constexpr long daysFromMar1(long y, long doy)    // doy from March 1st of y
+        {
+            return daysFromEra(floorDiv(y, 400), y - floorDiv(y, 400) * 400, doy);
+        }
+        static constexpr long daysFromEra(long era, long yoe, long doy)
+        {
+            return era * 146097L + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468L;
+        }
+        static constexpr CivilDate civilFromEra(long era, long doe)
+        {
+            return civilFromYoe(era * 400, (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365, doe);
+        }
+        static constexpr CivilDate civilFromYoe(long y, long yoe, long doe)   // y = first year of the era
+        {
+            return civilFromMar1(y + yoe, doe - (365 * yoe + yoe / 4 - yoe / 100));
+        }
+        static constexpr CivilDate civilFromMar1(long y, long doy)           // doy from March 1st of y
+        {
+            return civilFromMonth(y, doy, (5 * doy + 2) / 153);
+        }
+        static constexpr CivilDate civilFromMonth(long y, long doy, long mp)  // mp from March, Jan and Feb belong to the next year
+        {
+            return CivilDate{(int) (y + (mp >= 10)), (uint8_t) (mp < 10 ? mp + 3 : mp - 9), (uint8_t) (doy - (153 * mp + 2) / 5 + 1)};
+        }
+        static constexpr long nthDay(long first, int dow, int week)      // first = 1st day of the month
+        {
+            return first + (dow - weekday(first) + 7) % 7 + (week - 1) * 7;
+        }
+        static constexpr long changeDay(const TimeChangeRule &r, int y)
+        {
+            return r.week == JulianDay ? daysFromCivil(y, 1, 1) + r.yday - 1 + (isLeap(y) && r.yday >= 60)
+                : r.week == YearDay ? daysFromCivil(y, 1, 1) + r.yday
+                : r.week == Last
+                ? nthDay(daysFromCivil(y + (r.month == Dec), (r.month + 1) % 12 + 1, 1), r.dow, 1) - 7
+                : nthDay(daysFromCivil(y, r.month + 1, 1), r.dow, r.week);
+        }
+        void calcTimeChanges(int yr, TimeChanges *tc) const;
+        void checkTimeChanges(time_t t, TimeChanges *tc) const;
+        bool nextChange(time_t utc, time_t *change, TimeChanges *tc) const;
+        bool prevChange(time_t utc, time_t *change, TimeChanges *tc) const;
         void initTimeChanges();
-        time_t toTime_t(TimeChangeRule r, int yr);
         TimeChangeRule m_dst;   // rule for start of dst or summer time for any year
         TimeChangeRule m_std;   // rule for start of standard time for any year
-        time_t m_dstUTC;        // dst start for given/current year, given in UTC
-        struct tm m_tm_dstUTC;
-        time_t m_stdUTC;        // std time start for given/current year, given in UTC
-        time_t m_dstLoc;        // dst start for given/current year, given in local time
-        struct tm m_tm_dstLoc;
-        time_t m_stdLoc;        // std time start for given/current year, given in local time
+        TimeChanges m_tc;       // time change points of the given/current year
+#ifdef TZ_STATS
+        mutable TimezoneStats m_stats;
+#endif
 };
 #endif
@@ -0,0 +1,178 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * TimezoneBulk: column conversions of one Timezone, see TimezoneBulk.h *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#include "TimezoneBulk.h"
+
+#ifndef __AVR__
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+// Index of the year of a time in the table, from the time since the start
+// of the table u: (u >> YEAR_SHIFT) * YEAR_RECIP >> 32 is u divided by the
+// length of a leap year, so it is the index of the year or the previous
+// one (for up to 365 years).
+#define YEAR_SHIFT  15
+#define YEAR_RECIP  4450563ULL      // 2^32 * 2^YEAR_SHIFT / (366 * SECS_PER_DAY)
+
+/*----------------------------------------------------------------------*
+ * Create a column converter for the given Timezone, that must outlive  *
+ * it, with a table of its time changes from firstYear to lastYear      *
+ * included (at most TZ_BULK_YEARS years).                              *
+ *----------------------------------------------------------------------*/
+TimezoneBulk::TimezoneBulk(const Timezone &tz, int firstYear, int lastYear)
+    : m_tz(tz), m_firstYear(firstYear), m_years(lastYear - firstYear + 1)
+{
+    if (m_years < 0) m_years = 0;
+    if (m_years > TZ_BULK_YEARS) m_years = TZ_BULK_YEARS;
+    update();
+}
+
+/*----------------------------------------------------------------------*
+ * Recalculate the table, to be called if the rules of the Timezone     *
+ * are changed.                                                         *
+ *----------------------------------------------------------------------*/
+void TimezoneBulk::update()
+{
+    TimeChanges tc;
+
+    m_tc = TimeChanges();
+    m_yrStart[0] = (time_t) (Timezone::daysFromCivil(m_firstYear, 1, 1) - EPOCH_DAYS) * SECS_PER_DAY;
+    for (int i = 0; i < m_years; i++) {
+        m_tz.calcTimeChanges(m_firstYear + i - 1900, &tc);
+        m_yrStart[i + 1] = tc.yrEnd;
+        m_dstUTC[i] = tc.dstUTC;
+        m_stdUTC[i] = tc.stdUTC;
+    }
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given UTC time is within the DST interval,     *
+ * with the table or out of its range with Timezone::utcIsDST_r().      *
+ *----------------------------------------------------------------------*/
+inline bool TimezoneBulk::isDST(time_t utc)
+{
+    size_t i;
+
+    if (utc < m_yrStart[0] || utc >= m_yrStart[m_years]) return m_tz.utcIsDST_r(utc, &m_tc);
+
+    i = (size_t) (((unsigned long long) (utc - m_yrStart[0]) >> YEAR_SHIFT) * YEAR_RECIP >> 32);
+    i += utc >= m_yrStart[i + 1];
+
+    // same classification as Timezone::utcIsDST_r()
+    if (m_stdUTC[i] == m_dstUTC[i])         // daylight time not observed in this tz
+        return false;
+    else if (m_stdUTC[i] > m_dstUTC[i])     // northern hemisphere
+        return (utc >= m_dstUTC[i] && utc < m_stdUTC[i]);
+    else                                    // southern hemisphere
+        return !(utc >= m_stdUTC[i] && utc < m_dstUTC[i]);
+}
+
+#ifdef __AVX2__
+/*----------------------------------------------------------------------*
+ * Four elements at a time: all ones in the elements within the DST     *
+ * interval. The year index is found as in isDST(), and the DST         *
+ * interval is [dst, std) in the northern hemisphere and its complement *
+ * [yrStart, std) + [dst, yrEnd) in the southern one, that is           *
+ * t >= dst && t < std or t >= dst || t < std.                          *
+ *----------------------------------------------------------------------*/
+static inline __m256i isDST4(__m256i t, __m256i first, const long long *yrStart,
+    const long long *dstUTC, const long long *stdUTC)
+{
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    __m256i i, dst, std, c1, c2;
+
+    i = _mm256_srli_epi64(_mm256_sub_epi64(t, first), YEAR_SHIFT);
+    i = _mm256_srli_epi64(_mm256_mul_epu32(i, _mm256_set1_epi64x(YEAR_RECIP)), 32);
+    i = _mm256_sub_epi64(i, _mm256_xor_si256(_mm256_cmpgt_epi64(_mm256_i64gather_epi64(yrStart + 1, i, 8), t), ones));
+
+    dst = _mm256_i64gather_epi64(dstUTC, i, 8);
+    std = _mm256_i64gather_epi64(stdUTC, i, 8);
+    c1 = _mm256_xor_si256(_mm256_cmpgt_epi64(dst, t), ones);   // t >= dst
+    c2 = _mm256_cmpgt_epi64(std, t);                            // t < std
+    return _mm256_blendv_epi8(_mm256_and_si256(c1, c2), _mm256_or_si256(c1, c2), _mm256_cmpgt_epi64(dst, std));
+}
+
+/*----------------------------------------------------------------------*
+ * All ones if any of the four elements is out of the table range.      *
+ *----------------------------------------------------------------------*/
+static inline bool outOfRange4(__m256i t, __m256i first, __m256i last)
+{
+    __m256i out = _mm256_or_si256(_mm256_cmpgt_epi64(first, t),
+        _mm256_xor_si256(_mm256_cmpgt_epi64(last, t), _mm256_set1_epi64x(-1)));
+
+    return !_mm256_testz_si256(out, out);
+}
+#endif
+
+/*----------------------------------------------------------------------*
+ * Convert the n UTC times of the given array to local times.           *
+ *----------------------------------------------------------------------*/
+void TimezoneBulk::toLocal(const time_t *utc, time_t *local, size_t n)
+{
+    long dstOffset = m_tz.m_dst.offset * (long) SECS_PER_MIN;
+    long stdOffset = m_tz.m_std.offset * (long) SECS_PER_MIN;
+    size_t i = 0;
+
+#ifdef __AVX2__
+    static_assert(sizeof(time_t) == 8, "64 bit time_t required");
+    const __m256i first = _mm256_set1_epi64x(m_yrStart[0]);
+    const __m256i last = _mm256_set1_epi64x(m_yrStart[m_years]);
+    const __m256i std = _mm256_set1_epi64x(stdOffset);
+    const __m256i diff = _mm256_set1_epi64x(dstOffset - stdOffset);
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i *) (utc + i));
+
+        if (outOfRange4(t, first, last)) {
+            for (size_t j = i; j < i + 4; j++)
+                local[j] = utc[j] + (isDST(utc[j]) ? dstOffset : stdOffset);
+            continue;
+        }
+        __m256i dst = isDST4(t, first, (const long long *) m_yrStart,
+            (const long long *) m_dstUTC, (const long long *) m_stdUTC);
+        t = _mm256_add_epi64(_mm256_add_epi64(t, std), _mm256_and_si256(dst, diff));
+        _mm256_storeu_si256((__m256i *) (local + i), t);
+    }
+#endif
+    for (; i < n; i++)
+        local[i] = utc[i] + (isDST(utc[i]) ? dstOffset : stdOffset);
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether each of the n UTC times of the given array is      *
+ * within the DST interval or the Standard time interval.               *
+ *----------------------------------------------------------------------*/
+void TimezoneBulk::utcIsDST(const time_t *utc, bool *dst, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __AVX2__
+    const __m256i first = _mm256_set1_epi64x(m_yrStart[0]);
+    const __m256i last = _mm256_set1_epi64x(m_yrStart[m_years]);
+
+    for (; i + 4 <= n; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i *) (utc + i));
+
+        if (outOfRange4(t, first, last)) {
+            for (size_t j = i; j < i + 4; j++)
+                dst[j] = isDST(utc[j]);
+            continue;
+        }
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(isDST4(t, first, (const long long *) m_yrStart,
+            (const long long *) m_dstUTC, (const long long *) m_stdUTC)));
+        for (int j = 0; j < 4; j++)
+            dst[i + j] = mask >> j & 1;
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = isDST(utc[i]);
+}
+#endif
@@ -0,0 +1,45 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * TimezoneBulk: converts columns of UTC times of one Timezone, e.g.    *
+ * for data analysis on a host. The time change points of a range of    *
+ * years are precomputed into a table; the year of each element is      *
+ * found with integer arithmetic only, and its time change points are   *
+ * looked up in the table, so that the conversion of a column has no    *
+ * branches. With AVX2 (e.g. -mavx2 or -march=native) four elements are *
+ * converted at a time, with gathers from the table. The results are    *
+ * the same as the ones of Timezone::toLocal() and utcIsDST(), that is  *
+ * used for the elements out of the range of the table. Not on avr.     *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef TimezoneBulk_h
+#define TimezoneBulk_h
+#include "Timezone.h"
+
+#ifndef __AVR__
+#define TZ_BULK_YEARS   256         // maximum number of years of the table
+
+class TimezoneBulk
+{
+    public:
+        TimezoneBulk(const Timezone &tz, int firstYear = 1970, int lastYear = 2100);
+        void update();
+        void toLocal(const time_t *utc, time_t *local, size_t n);
+        void utcIsDST(const time_t *utc, bool *dst, size_t n);
+
+    private:
+        bool isDST(time_t utc);
+        const Timezone &m_tz;
+        TimeChanges m_tc;                       // out of the range of the table
+        int m_firstYear;
+        int m_years;
+        time_t m_yrStart[TZ_BULK_YEARS + 1];    // start of each year, and end of the last one
+        time_t m_dstUTC[TZ_BULK_YEARS];         // time change points of each year, in UTC
+        time_t m_stdUTC[TZ_BULK_YEARS];
+};
+#endif
+#endif
@@ -0,0 +1,121 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * TimezoneSet: converts one UTC time to the local times of many        *
+ * Timezone objects at once (e.g. a world clock). The year of the UTC   *
+ * time is found once for the whole set, and zones changing time at     *
+ * the same UTC instants (e.g. the EU zones, all at 01:00 UTC) share    *
+ * their time change points and DST classification.                     *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef TimezoneSet_h
+#define TimezoneSet_h
+#include "Timezone.h"
+
+// N is the maximum number of zones of the set
+template <uint8_t N>
+class TimezoneSet
+{
+    public:
+        TimezoneSet() : m_count(0) {}
+
+        /*----------------------------------------------------------------------*
+         * Add the given Timezone to the set, returns false if the set is full. *
+         * The Timezone must outlive the set. Call update() if the rules of a   *
+         * zone of the set are changed later.                                   *
+         *----------------------------------------------------------------------*/
+        bool add(Timezone &tz)
+        {
+            if (m_count >= N) return false;
+            m_zones[m_count++] = &tz;
+            update();
+            return true;
+        }
+
+        uint8_t count() const
+        {
+            return m_count;
+        }
+
+        /*----------------------------------------------------------------------*
+         * Group the zones with the same UTC time changes, and force the        *
+         * calculation of the time change points at next conversion call.       *
+         *----------------------------------------------------------------------*/
+        void update()
+        {
+            for (uint8_t i = 0; i < m_count; i++) {
+                m_group[i] = i;
+                for (uint8_t j = 0; j < i; j++) {
+                    if (m_group[j] == j && sameChanges(*m_zones[i], *m_zones[j])) {
+                        m_group[i] = j;
+                        break;
+                    }
+                }
+                m_tc[i] = TimeChanges();
+            }
+        }
+
+        /*----------------------------------------------------------------------*
+         * Convert the given UTC time to the local time of each zone of the     *
+         * set, in the order they were added. If tcr is not NULL, it also       *
+         * returns the time change rule used for each zone. The caller must     *
+         * take care not to alter these rules.                                  *
+         *----------------------------------------------------------------------*/
+        void toLocal(time_t utc, time_t *local, TimeChangeRule **tcr = NULL)
+        {
+            bool dst[N];
+            TimeChangeRule *r;
+
+            if (m_count == 0) return;
+
+            // Recalculate the time change points of every group if needed:
+            // all of them cache the same year
+            if (utc < m_tc[0].yrStart || utc >= m_tc[0].yrEnd) {
+                int yr = Timezone::yearOf(utc);
+                for (uint8_t g = 0; g < m_count; g++)
+                    if (m_group[g] == g) m_zones[g]->calcTimeChanges(yr, &m_tc[g]);
+            }
+
+            for (uint8_t i = 0; i < m_count; i++) {
+                uint8_t g = m_group[i];
+                dst[i] = (g == i) ? m_zones[i]->utcIsDST_r(utc, &m_tc[i]) : dst[g];
+                r = dst[i] ? &m_zones[i]->m_dst : &m_zones[i]->m_std;
+                local[i] = utc + r->offset * (long) SECS_PER_MIN;
+                if (tcr) tcr[i] = r;
+            }
+        }
+
+    private:
+        /*----------------------------------------------------------------------*
+         * Two zones change time at the same UTC instants if their rules fall   *
+         * on the same days and at the same time once shifted to UTC.           *
+         *----------------------------------------------------------------------*/
+        static bool sameChanges(const Timezone &a, const Timezone &b)
+        {
+            return sameDay(a.m_dst, b.m_dst) && sameDay(a.m_std, b.m_std)
+                && minutes(a.m_dst) - a.m_std.offset == minutes(b.m_dst) - b.m_std.offset
+                && minutes(a.m_std) - a.m_dst.offset == minutes(b.m_std) - b.m_dst.offset;
+        }
+
+        static bool sameDay(const TimeChangeRule &a, const TimeChangeRule &b)
+        {
+            if (a.week != b.week) return false;
+            if (a.week == JulianDay || a.week == YearDay) return a.yday == b.yday;
+            return a.dow == b.dow && a.month == b.month;
+        }
+
+        static int minutes(const TimeChangeRule &r)
+        {
+            return r.hour * 60 + r.minute;
+        }
+
+        Timezone *m_zones[N];
+        uint8_t m_group[N];         // index of the first zone with the same time changes
+        TimeChanges m_tc[N];        // time change points, for the first zone of each group only
+        uint8_t m_count;
+};
+#endif
@@ -0,0 +1,93 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * TimezoneStream: converts a feed of increasing UTC times (e.g. from   *
+ * a GPS or NTP clock, one per sample) to local time. It remembers the  *
+ * offset in effect and the interval of UTC times it is valid for,      *
+ * from the last time change to the next one, so that converting a      *
+ * time within it is a compare and an add. The Timezone is used again   *
+ * only when a time crosses the next time change or goes backwards out  *
+ * of the interval.                                                     *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef TimezoneStream_h
+#define TimezoneStream_h
+#include "Timezone.h"
+
+class TimezoneStream
+{
+    public:
+        // The Timezone must outlive the stream
+        TimezoneStream(Timezone &tz) : m_tz(tz)
+        {
+            reset();
+        }
+
+        /*----------------------------------------------------------------------*
+         * Forget the cached interval, to be called if the rules of the         *
+         * Timezone are changed.                                                *
+         *----------------------------------------------------------------------*/
+        void reset()
+        {
+            m_from = 1;
+            m_until = 0;
+        }
+
+        time_t toLocal(time_t utc)
+        {
+            if (utc >= m_until || utc < m_from) seek(utc);
+            return utc + m_offset;
+        }
+
+        /*----------------------------------------------------------------------*
+         * Convert the given UTC time to local time, and return the time        *
+         * change rule used. The caller must take care not to alter it.         *
+         *----------------------------------------------------------------------*/
+        time_t toLocal(time_t utc, TimeChangeRule **tcr)
+        {
+            if (utc >= m_until || utc < m_from) seek(utc);
+            *tcr = m_tcr;
+            return utc + m_offset;
+        }
+
+        bool utcIsDST(time_t utc)
+        {
+            if (utc >= m_until || utc < m_from) seek(utc);
+            return m_dst;
+        }
+
+        // UTC instant at which the cached offset expires, i.e. the next time change
+        time_t until() const
+        {
+            return m_until;
+        }
+
+    private:
+        /*----------------------------------------------------------------------*
+         * Find the offset in effect at the given UTC time and the interval     *
+         * between the time changes around it. If daylight time is not          *
+         * observed in this tz, the interval is the year of the given time.     *
+         *----------------------------------------------------------------------*/
+        void seek(time_t utc)
+        {
+            m_offset = m_tz.toLocal(utc, &m_tcr) - utc;
+            m_dst = m_tz.utcIsDST(utc);
+            if (!m_tz.prevTransition(utc, &m_from) || !m_tz.nextTransition(utc, &m_until)) {
+                int yr = Timezone::yearOf(utc) + 1900;
+                m_from = (time_t) (Timezone::daysFromCivil(yr, 1, 1) - EPOCH_DAYS) * SECS_PER_DAY;
+                m_until = (time_t) (Timezone::daysFromCivil(yr + 1, 1, 1) - EPOCH_DAYS) * SECS_PER_DAY;
+            }
+        }
+
+        Timezone &m_tz;
+        time_t m_from;              // [m_from, m_until) interval of UTC times of the cached offset
+        time_t m_until;
+        long m_offset;              // offset from UTC in seconds
+        TimeChangeRule *m_tcr;
+        bool m_dst;
+};
+#endif
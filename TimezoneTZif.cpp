@@ -0,0 +1,281 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * TZifTimezone: a time zone read from a compiled TZif file, see        *
+ * TimezoneTZif.h and RFC 8536 for the file format.                     *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#include "TimezoneTZif.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TZIF_HEADER     44      // size of the header
+#define TZIF_TTINFO     6       // size of a local time type record
+
+static TimeChangeRule UTC = {"UTC", Last, Sun, Jan, 0, 0, 0, 0};
+
+/*----------------------------------------------------------------------*
+ * Big endian integers, read in place from the mapped file.             *
+ *----------------------------------------------------------------------*/
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static int64_t be64(const uint8_t *p)
+{
+    return (int64_t) ((uint64_t) be32(p) << 32 | be32(p + 4));
+}
+
+/*----------------------------------------------------------------------*
+ * Size of the data block that follows the given header, for transition *
+ * times of timeSize bytes. Computed in 64 bits, so that the counts     *
+ * read from the file cannot wrap before the bounds check.              *
+ *----------------------------------------------------------------------*/
+static uint64_t dataSize(const uint8_t *hdr, int timeSize)
+{
+    return be32(hdr + 32) * (uint64_t) (timeSize + 1) + be32(hdr + 36) * (uint64_t) TZIF_TTINFO
+        + be32(hdr + 40) + be32(hdr + 28) * (uint64_t) (timeSize + 4)
+        + (uint64_t) be32(hdr + 24) + be32(hdr + 20);
+}
+
+TZifTimezone::TZifTimezone()
+    : m_map(NULL), m_size(0), m_timecnt(0), m_typecnt(0), m_charcnt(0), m_rules(UTC), m_hasRules(false)
+{
+}
+
+TZifTimezone::~TZifTimezone()
+{
+    close();
+}
+
+/*----------------------------------------------------------------------*
+ * Map the given TZif file, version 2 or later, and check its layout.   *
+ * Returns false if the file cannot be read or is not a valid TZif.     *
+ *----------------------------------------------------------------------*/
+bool TZifTimezone::open(const char *path)
+{
+    struct stat st;
+    const uint8_t *p, *end;
+    uint32_t isutcnt, isstdcnt, leapcnt;
+    TimeChangeRule dst, std;
+    const char *footerEnd;
+    int fd;
+
+    close();
+    if ((fd = ::open(path, O_RDONLY)) < 0) return false;
+    if (fstat(fd, &st) == 0 && st.st_size >= TZIF_HEADER) {
+        m_size = st.st_size;
+        m_map = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_map == MAP_FAILED) m_map = NULL;
+    }
+    ::close(fd);
+    if (!m_map) return false;
+
+    // skip the version 1 header and data block, to the 64 bit one
+    p = (const uint8_t *) m_map;
+    end = p + m_size;
+    if (memcmp(p, "TZif", 4) != 0 || p[4] < '2') {
+        close();
+        return false;
+    }
+    if (dataSize(p, 4) > (uint64_t) (end - p - TZIF_HEADER)) {
+        close();
+        return false;
+    }
+    p += TZIF_HEADER + dataSize(p, 4);
+    if (end - p < TZIF_HEADER || memcmp(p, "TZif", 4) != 0
+        || dataSize(p, 8) > (uint64_t) (end - p - TZIF_HEADER)) {
+        close();
+        return false;
+    }
+
+    isutcnt = be32(p + 20);
+    isstdcnt = be32(p + 24);
+    leapcnt = be32(p + 28);
+    m_timecnt = be32(p + 32);
+    m_typecnt = be32(p + 36);
+    m_charcnt = be32(p + 40);
+    m_times = p + TZIF_HEADER;
+    m_types = m_times + m_timecnt * (size_t) 8;
+    m_ttinfo = m_types + m_timecnt;
+    m_chars = (const char *) m_ttinfo + m_typecnt * (size_t) TZIF_TTINFO;
+    p = (const uint8_t *) m_chars + m_charcnt + leapcnt * (size_t) 12 + isstdcnt + isutcnt;
+    // the designations are NUL terminated strings, the last one included
+    if (m_typecnt == 0 || m_typecnt > 256 || m_charcnt == 0 || m_chars[m_charcnt - 1] != 0) {
+        close();
+        return false;
+    }
+    for (uint32_t i = 0; i < m_timecnt; i++) {
+        if (m_types[i] >= m_typecnt) {
+            close();
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < m_typecnt; i++) {
+        if (ttinfo(i)[5] >= m_charcnt) {
+            close();
+            return false;
+        }
+    }
+
+    // footer, between newlines: rules after the last transition
+    m_hasRules = p < end && *p == '\n' && memchr(p + 1, '\n', end - p - 1)
+        && Timezone::parseRules((const char *) p + 1, &dst, &std, &footerEnd) && *footerEnd == '\n';
+    if (m_hasRules) m_rules.setRules(dst, std);
+    return true;
+}
+
+/*----------------------------------------------------------------------*
+ * Unmap the file.                                                      *
+ *----------------------------------------------------------------------*/
+void TZifTimezone::close()
+{
+    if (m_map) munmap(m_map, m_size);
+    m_map = NULL;
+    m_size = 0;
+    m_timecnt = 0;
+    m_typecnt = 0;
+    m_hasRules = false;
+}
+
+/*----------------------------------------------------------------------*
+ * Convert the given UTC time to local time.                            *
+ *----------------------------------------------------------------------*/
+time_t TZifTimezone::toLocal(time_t utc)
+{
+    const uint8_t *tt = findUTC(utc);
+
+    if (!tt) return m_hasRules ? m_rules.toLocal(utc) : utc;
+    return utc + utoff(tt);
+}
+
+/*----------------------------------------------------------------------*
+ * Convert the given UTC time to local time, and return the time zone   *
+ * abbreviation in use. The caller must take care not to alter it.      *
+ *----------------------------------------------------------------------*/
+time_t TZifTimezone::toLocal(time_t utc, const char **abbrev)
+{
+    const uint8_t *tt = findUTC(utc);
+    TimeChangeRule *tcr;
+    time_t local;
+
+    if (!tt) {
+        if (!m_hasRules) {
+            *abbrev = UTC.abbrev;
+            return utc;
+        }
+        local = m_rules.toLocal(utc, &tcr);
+        *abbrev = tcr->abbrev;
+        return local;
+    }
+    *abbrev = m_chars + tt[5];
+    return utc + utoff(tt);
+}
+
+/*----------------------------------------------------------------------*
+ * Convert the given local time to UTC time. As for Timezone::toUTC(),  *
+ * local times during a transition interval are ambiguous: the ones     *
+ * that occur twice are treated as the earlier time.                    *
+ *----------------------------------------------------------------------*/
+time_t TZifTimezone::toUTC(time_t local)
+{
+    const uint8_t *tt = findLoc(local);
+
+    if (!tt) return m_hasRules ? m_rules.toUTC(local) : local;
+    return local - utoff(tt);
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given UTC time_t is within the DST interval    *
+ * or the Standard time interval.                                       *
+ *----------------------------------------------------------------------*/
+bool TZifTimezone::utcIsDST(time_t utc)
+{
+    const uint8_t *tt = findUTC(utc);
+
+    if (!tt) return m_hasRules && m_rules.utcIsDST(utc);
+    return tt[4];
+}
+
+/*----------------------------------------------------------------------*
+ * Determine whether the given Local time_t is within the DST interval  *
+ * or the Standard time interval.                                       *
+ *----------------------------------------------------------------------*/
+bool TZifTimezone::locIsDST(time_t local)
+{
+    const uint8_t *tt = findLoc(local);
+
+    if (!tt) return m_hasRules && m_rules.locIsDST(local);
+    return tt[4];
+}
+
+/*----------------------------------------------------------------------*
+ * Find the local time type in effect at the given UTC time, by binary  *
+ * search of the transitions. Returns NULL after the last transition    *
+ * (or if the file is not open): the footer rules apply.                *
+ *----------------------------------------------------------------------*/
+const uint8_t *TZifTimezone::findUTC(time_t utc) const
+{
+    uint32_t lo = 0, hi = m_timecnt, mid;
+
+    if (!m_map) return NULL;
+
+    // binary search of the first transition after utc
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (transition(mid) <= utc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == m_timecnt && m_hasRules) return NULL;
+    return ttinfo(lo > 0 ? m_types[lo - 1] : 0);    // type 0 before the first transition
+}
+
+/*----------------------------------------------------------------------*
+ * Find the local time type in effect at the given local time. A        *
+ * transition happens, in local time, at its UTC time plus the offset   *
+ * of the local time type in effect before it.                          *
+ *----------------------------------------------------------------------*/
+const uint8_t *TZifTimezone::findLoc(time_t local) const
+{
+    uint32_t lo = 0, hi = m_timecnt, mid;
+
+    if (!m_map) return NULL;
+
+    // binary search of the first transition after local
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (transition(mid) + utoff(ttinfo(mid > 0 ? m_types[mid - 1] : 0)) <= local)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == m_timecnt && m_hasRules) return NULL;
+    return ttinfo(lo > 0 ? m_types[lo - 1] : 0);
+}
+
+int64_t TZifTimezone::transition(uint32_t i) const
+{
+    return be64(m_times + i * 8);
+}
+
+const uint8_t *TZifTimezone::ttinfo(uint8_t i) const
+{
+    return m_ttinfo + i * TZIF_TTINFO;
+}
+
+long TZifTimezone::utoff(const uint8_t *tt) const
+{
+    return (int32_t) be32(tt);
+}
+#endif
@@ -0,0 +1,55 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * TZifTimezone: a time zone read from a compiled TZif file of the      *
+ * IANA tz database (e.g. /usr/share/zoneinfo/Europe/Rome), with all    *
+ * its historical rule changes. The file is memory mapped and the       *
+ * conversions binary search its transition arrays in place. After the  *
+ * last transition, the rules of the POSIX TZ string footer of the file *
+ * are used, through a Timezone object. POSIX hosts only (mmap).        *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#ifndef TimezoneTZif_h
+#define TimezoneTZif_h
+#include "Timezone.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+class TZifTimezone
+{
+    public:
+        TZifTimezone();
+        ~TZifTimezone();
+        bool open(const char *path);
+        void close();
+        time_t toLocal(time_t utc);
+        time_t toLocal(time_t utc, const char **abbrev);
+        time_t toUTC(time_t local);
+        bool utcIsDST(time_t utc);
+        bool locIsDST(time_t local);
+
+    private:
+        TZifTimezone(const TZifTimezone &);             // not copyable, owns the mapping
+        TZifTimezone &operator=(const TZifTimezone &);
+        const uint8_t *findUTC(time_t utc) const;
+        const uint8_t *findLoc(time_t local) const;
+        int64_t transition(uint32_t i) const;
+        const uint8_t *ttinfo(uint8_t i) const;
+        long utoff(const uint8_t *tt) const;
+        void *m_map;                // mapped file, NULL if not open
+        size_t m_size;
+        const uint8_t *m_times;     // transition times, 64 bit big endian
+        const uint8_t *m_types;     // index of the local time type of each transition
+        const uint8_t *m_ttinfo;    // local time types: utoff (32 bit big endian), isdst, desigidx
+        const char *m_chars;        // time zone designations
+        uint32_t m_timecnt;
+        uint32_t m_typecnt;
+        uint32_t m_charcnt;
+        Timezone m_rules;           // footer rules, after the last transition
+        bool m_hasRules;
+};
+#endif
+#endif
@@ -0,0 +1,22 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * Host shim of Arduino.h, to build the library on a PC with the C      *
+ * library time.h instead of avr-libc.                                  *
+ *----------------------------------------------------------------------*/
+
+#ifndef Arduino_h
+#define Arduino_h
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+// avr-libc time.h: inverse of gmtime(), timegm() of the C library
+static inline time_t mk_gmtime(const struct tm *timeptr)
+{
+    struct tm tm = *timeptr;
+    return timegm(&tm);
+}
+#endif
@@ -0,0 +1,720 @@
+/*----------------------------------------------------------------------*
+ * Arduino Timezone Library v1.3                                        *
+ * Gionata Boccalini                                                    *
+ *                                                                      *
+ * tzbench: host benchmark of the conversion functions. It first checks *
+ * the conversions of a few zones against the C library localtime_r(),  *
+ * given the same POSIX TZ string, then times each toLocal(), toUTC(),  *
+ * utcIsDST() and locIsDST() overload on three patterns of timestamps:  *
+ * sequential (one per minute), random (1970-2100) and alternating      *
+ * across a new year (the worst case for the per-year cache), and the   *
+ * TimezoneBulk and TimezoneStream conversions, that are checked to     *
+ * give the same results as the Timezone ones. TZifTimezone is checked  *
+ * against localtime_r() on the zoneinfo files of the host. The rules   *
+ * serialized by saveRules() are checked to load back the same.         *
+ *                                                                      *
+ *   tzbench [--verify] [-n count]                                      *
+ *                                                                      *
+ * Built with -DTZ_STATS (and -DTZ_STATS_CYCLES), it also prints the    *
+ * statistics of the Timezone used by the benchmark.                    *
+ *                                                                      *
+ * Arduino Timezone Library Copyright (C) 2018 by Jack Christensen and  *
+ * licensed under GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html   *
+ *----------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <Timezone.h>
+#include <TimezoneBulk.h>
+#include <StaticTimezone.h>
+#include <TimezoneStream.h>
+#include <TimezoneTZif.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define HAVE_CYCLES 1
+#endif
+
+#define BENCH_SIZE  4096            // timestamps per pattern, fit in L1 with their results
+#define BENCH_OPS   4000000L        // conversions per measure (default)
+
+static const char *ZONES[] = {
+    "CET-1CEST,M3.5.0,M10.5.0/3",               // Central Europe
+    "EST5EDT,M3.2.0,M11.1.0",                   // US Eastern
+    "AEST-10AEDT,M10.1.0,M4.1.0/3",             // Sydney, southern hemisphere
+    "<+1245>-12:45<+1345>,M9.5.0/2:45,M4.1.0/3:45",     // Chatham, minutes
+    "<-02>2<-01>,M3.5.0/-1,M10.5.0/0",          // Nuuk, negative time
+    "<-03>3<-02>,M9.1.6/24,M4.1.6/24",          // Santiago, time 24
+    "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0",     // Lord Howe, 30 minutes DST
+    "IST-2IDT,M3.4.4/26,M10.5.0",               // Israel, time 26
+    "IST-1GMT0,M10.5.0,M3.5.0/1",               // Dublin, negative DST
+    "JST-9",                                    // no DST
+};
+
+static const char *TZIF_ZONES[] = {
+    "Europe/Rome", "America/New_York", "Australia/Lord_Howe", "Pacific/Chatham",
+    "America/Santiago", "Asia/Tehran", "Europe/Dublin", "America/Sao_Paulo",
+    "Africa/Casablanca", "Asia/Kolkata",
+};
+
+#define TZIF_DIR    "/usr/share/zoneinfo/"
+
+static constexpr TimeChangeRule CEST = {"CEST", Last, Sun, Mar, 2, 120, 0, 0};
+static constexpr TimeChangeRule CET = {"CET", Last, Sun, Oct, 3, 60, 0, 0};
+static constexpr TimeChangeRule JST = {"JST", Last, Sun, Jan, 0, 540, 0, 0};
+
+static TimeChangeRule UTC = {"UTC", Last, Sun, Jan, 0, 0, 0, 0};
+static unsigned long rnd = 1;
+
+// 31 bit pseudo random numbers, the same on every host
+static long random31()
+{
+    rnd = rnd * 1103515245UL + 12345UL;
+    return (long) ((rnd >> 1) & 0x7fffffffL);
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long cycles()
+{
+#ifdef HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*----------------------------------------------------------------------*
+ * Check the conversions of the Timezone against localtime_r() for the  *
+ * given UTC time. Returns the number of mismatches.                    *
+ *----------------------------------------------------------------------*/
+static int check(Timezone &tz, const char *zone, time_t utc)
+{
+    struct tm tm;
+    TimeChangeRule *tcr;
+    time_t local, back;
+    int errors = 0;
+
+    localtime_r(&utc, &tm);
+    local = tz.toLocal(utc, &tcr);
+    if (local != utc + tm.tm_gmtoff || strcmp(tcr->abbrev, tm.tm_zone) != 0) {
+        printf("%s: toLocal(%lld) = %lld %s, localtime_r %lld %s\n", zone, (long long) utc,
+            (long long) local, tcr->abbrev, (long long) (utc + tm.tm_gmtoff), tm.tm_zone);
+        errors++;
+    }
+    if (tz.utcIsDST(utc) != (tm.tm_isdst > 0)) {
+        printf("%s: utcIsDST(%lld) = %d, localtime_r %d\n", zone, (long long) utc,
+            tz.utcIsDST(utc), tm.tm_isdst);
+        errors++;
+    }
+
+    // same string as strftime()
+    char buf[TZ_FORMAT_SIZE], expected[64];
+    long offset = tm.tm_gmtoff / SECS_PER_MIN;
+    size_t len = strftime(expected, sizeof(expected), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(expected + len, sizeof(expected) - len, "%c%02d:%02d %s", offset < 0 ? '-' : '+',
+        (int) (labs(offset) / 60), (int) (labs(offset) % 60), tm.tm_zone);
+    if (tz.format(utc, buf, RFC3339Abbrev) != strlen(expected) || strcmp(buf, expected) != 0) {
+        printf("%s: format(%lld) = %s, strftime %s\n", zone, (long long) utc, buf, expected);
+        errors++;
+    }
+
+    // local times that occur twice map to the earlier UTC time
+    back = tz.toUTC(local);
+    if (back != utc && !(back < utc && tz.toLocal(back) == local)) {
+        printf("%s: toUTC(%lld) = %lld, expected %lld\n", zone, (long long) local,
+            (long long) back, (long long) utc);
+        errors++;
+    }
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * Check toUTC() with each policy for the given local time, against the *
+ * UTC times that toLocal() maps to it, given the two offsets of the    *
+ * zone: none in a gap, two in a fold. Returns the number of mismatches.*
+ *----------------------------------------------------------------------*/
+static int checkPolicy(Timezone &tz, const char *zone, time_t local, long minOffset, long maxOffset)
+{
+    static const char *TYPES[] = {"Valid", "Gap", "Fold"};
+    static const localPolicy_t POLICIES[] = {Earlier, Later, Reject, ShiftForward};
+    time_t earlier = local - maxOffset, later = local - minOffset, change, expected, utc;
+    localTime_t type, expType;
+    int errors = 0;
+
+    if (tz.toLocal(earlier) == local && tz.toLocal(later) == local && earlier != later)
+        expType = Fold;
+    else if (tz.toLocal(earlier) != local && tz.toLocal(later) != local)
+        expType = Gap;
+    else
+        expType = Valid;
+
+    for (size_t p = 0; p < sizeof(POLICIES) / sizeof(POLICIES[0]); p++) {
+        if (expType == Valid)
+            expected = tz.toLocal(earlier) == local ? earlier : later;
+        else if (expType == Fold)
+            expected = POLICIES[p] == Later ? later : earlier;
+        else if (POLICIES[p] == ShiftForward)
+            expected = later;
+        else
+            expected = tz.prevTransition(later, &change) ? change : later;
+
+        bool ok = tz.toUTC(local, &utc, POLICIES[p], &type);
+        if (type != expType || ok != (expType == Valid || POLICIES[p] != Reject) || (ok && utc != expected)) {
+            printf("%s: toUTC(%lld, policy %d) = %d %lld %s, expected %lld %s\n", zone, (long long) local,
+                (int) POLICIES[p], ok, (long long) utc, TYPES[type], (long long) expected, TYPES[expType]);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * Check a StaticTimezone and its compile time table against a Timezone *
+ * with the same rules, at random times from 2000 to 2030. Returns the  *
+ * number of mismatches.                                                *
+ *----------------------------------------------------------------------*/
+template <const TimeChangeRule &DST, const TimeChangeRule &STD>
+static int checkStatic(const char *zone)
+{
+    typedef StaticTimezone<DST, STD> Z;
+    TimeChangeTable table = Z::template table<2000, 2030>();
+    Timezone tz(DST, STD);
+    int errors = 0;
+
+    for (long i = 0; i < 100000L && errors < 20; i++) {
+        time_t t = 946684800LL + (time_t) random31() % (31 * 365 * (time_t) SECS_PER_DAY);
+        if (Z::toLocal(t) != tz.toLocal(t) || Z::utcIsDST(t) != tz.utcIsDST(t) || Z::toUTC(t) != tz.toUTC(t)
+            || table.toLocal(t) != tz.toLocal(t) || table.utcIsDST(t) != tz.utcIsDST(t)
+            || table.toUTC(t) != tz.toUTC(t) || table.locIsDST(t) != tz.locIsDST(t)) {
+            printf("%s: StaticTimezone(%lld) = %lld %d, table %lld %d, Timezone %lld %d\n", zone, (long long) t,
+                (long long) Z::toLocal(t), Z::utcIsDST(t), (long long) table.toLocal(t), table.utcIsDST(t),
+                (long long) tz.toLocal(t), tz.utcIsDST(t));
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * Check that the TimezoneBulk conversions give the same results as the *
+ * Timezone ones, in and out of the range of its table (1970-2100),     *
+ * around each time change and at random times. Returns the number of   *
+ * mismatches.                                                          *
+ *----------------------------------------------------------------------*/
+static int checkBulk(Timezone &tz, const char *zone)
+{
+    static time_t utc[BENCH_SIZE], local[BENCH_SIZE];
+    static bool dst[BENCH_SIZE];
+    TimezoneBulk bulk(tz);
+    time_t t = -(time_t) SECS_PER_DAY * 366 * 2, change;
+    int errors = 0;
+
+    for (int round = 0; round < 64 && errors < 20; round++) {
+        for (int i = 0; i < BENCH_SIZE; i += 2) {
+            if (round & 1)
+                utc[i] = utc[i + 1] = -(time_t) SECS_PER_DAY * 366 * 2 + (time_t) random31() * 2;
+            else if (tz.nextTransition(t, &change))
+                t = change;
+            else
+                t += SECS_PER_DAY * 7;
+            if (!(round & 1)) {
+                utc[i] = t - 1;
+                utc[i + 1] = t;
+            }
+        }
+        bulk.toLocal(utc, local, BENCH_SIZE);
+        bulk.utcIsDST(utc, dst, BENCH_SIZE);
+        for (int i = 0; i < BENCH_SIZE && errors < 20; i++) {
+            if (local[i] != tz.toLocal(utc[i]) || dst[i] != tz.utcIsDST(utc[i])) {
+                printf("%s: TimezoneBulk(%lld) = %lld %d, Timezone %lld %d\n", zone, (long long) utc[i],
+                    (long long) local[i], dst[i], (long long) tz.toLocal(utc[i]), tz.utcIsDST(utc[i]));
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * Check that the TimezoneStream conversions give the same results as   *
+ * the Timezone ones, for increasing times (one per minute around the   *
+ * time changes) and times going backwards. Returns the number of       *
+ * mismatches.                                                          *
+ *----------------------------------------------------------------------*/
+static int checkStream(Timezone &tz, const char *zone)
+{
+    TimezoneStream stream(tz);
+    TimeChangeRule *tcr, *tzTcr;
+    time_t t = 0, change, utc;
+    int errors = 0;
+
+    for (int i = 0; i < 4000 && errors < 20; i++) {
+        if (!tz.nextTransition(t, &change)) change = t + SECS_PER_DAY * 100;
+        for (utc = change - SECS_PER_HOUR; utc < change + SECS_PER_HOUR && errors < 20; utc += SECS_PER_MIN) {
+            time_t u = (i & 1) ? utc : change + change - utc;     // backwards every other change
+            if (stream.toLocal(u, &tcr) != tz.toLocal(u, &tzTcr) || tcr != tzTcr
+                || stream.utcIsDST(u) != tz.utcIsDST(u)) {
+                printf("%s: TimezoneStream(%lld) = %lld, Timezone %lld\n", zone, (long long) u,
+                    (long long) stream.toLocal(u), (long long) tz.toLocal(u));
+                errors++;
+            }
+        }
+        t = change + SECS_PER_DAY * (random31() % 60);
+    }
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * Check that the rules and a table of time changes saved with          *
+ * saveRules() load back the same, from memory and from a file, and     *
+ * that a truncated or corrupted buffer is rejected without changing    *
+ * the rules. Returns the number of mismatches.                         *
+ *----------------------------------------------------------------------*/
+static int checkRules(Timezone &tz, const char *zone)
+{
+    static TimeChange changes[40], loaded[40];
+    uint8_t buf[TZ_RULES_SIZE(40)], saved[TZ_RULES_SIZE(40)];
+    char path[64];
+    size_t count = tz.makeTable(changes, 40, 2020, 2039), n, size;
+    Timezone back(UTC);
+    int errors = 0;
+
+    size = tz.saveRules(buf, sizeof(buf), changes, count);
+    n = 40;
+    if (size != (size_t) TZ_RULES_SIZE(count) || !back.loadRules(buf, size, Memory, loaded, &n) || n != count) {
+        printf("%s: saveRules()/loadRules() round trip failed\n", zone);
+        errors++;
+        n = 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (loaded[i].utc != changes[i].utc || loaded[i].offset != changes[i].offset || loaded[i].dst != changes[i].dst) {
+            printf("%s: loaded time change %d differs\n", zone, (int) i);
+            errors++;
+        }
+    }
+
+    // same bytes once saved again, and same conversions
+    if (back.saveRules(saved, sizeof(saved), loaded, n) != size || memcmp(saved, buf, size) != 0) {
+        printf("%s: loaded rules saved differently\n", zone);
+        errors++;
+    }
+    for (int i = 0; i < 1000 && errors < 20; i++) {
+        time_t t = (time_t) random31() * 2;
+        if (back.toLocal(t) != tz.toLocal(t) || back.toUTC(t) != tz.toUTC(t)) {
+            printf("%s: loaded rules toLocal(%lld) = %lld, expected %lld\n", zone, (long long) t,
+                (long long) back.toLocal(t), (long long) tz.toLocal(t));
+            errors++;
+        }
+    }
+
+    snprintf(path, sizeof(path), "/tmp/tzbench-%d.tzr", (int) getpid());
+    FILE *f = fopen(path, "wb");
+    if (f) {
+        Timezone file(UTC);
+        fwrite(buf, 1, size, f);
+        fclose(f);
+        if (!file.loadRules(path) || file.toLocal(changes[0].utc) != tz.toLocal(changes[0].utc)) {
+            printf("%s: loadRules(path) failed\n", zone);
+            errors++;
+        }
+        remove(path);
+    }
+
+    // each byte corrupted in turn, and the truncated buffer
+    for (size_t i = 0; i < size; i++) {
+        Timezone bad(UTC);
+        memcpy(saved, buf, size);
+        saved[i] ^= 0x5a;
+        if (bad.loadRules(saved, size) || bad.toLocal(86400L * 180) != 86400L * 180) {
+            printf("%s: loadRules() accepted byte %d corrupted\n", zone, (int) i);
+            errors++;
+        }
+    }
+    if (back.loadRules(buf, size - 1)) {
+        printf("%s: loadRules() accepted a truncated buffer\n", zone);
+        errors++;
+    }
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * Check the exact bytes saved for Central European rules with one time *
+ * change: the format is little endian and packed on every host, so it  *
+ * must not depend on the byte order or the struct layout of this one.  *
+ * Returns the number of mismatches.                                    *
+ *----------------------------------------------------------------------*/
+static int checkRulesBytes()
+{
+    static const uint8_t EXPECTED[TZ_RULES_SIZE(1)] = {
+        'T', 'Z', 0x01, 0x00, 0x01, 0x00,                                       // header, 1 change
+        'C', 'E', 'S', 'T', 0, 0, 0x00, 0x00, 0x02, 0x02, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00,
+        'C', 'E', 'T', 0, 0, 0, 0x00, 0x00, 0x09, 0x03, 0x3c, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x10, 0xd5, 0x5f, 0x60, 0x00, 0x00, 0x00, 0x00, 0x78, 0x00, 0x01,       // 2021-03-28 01:00 UTC
+        0xa1, 0xc4,                                                             // Fletcher-16
+    };
+    TimeChange change = {1616893200L, 120, 1}, loaded;
+    Timezone tz(CEST, CET), back(UTC);
+    uint8_t buf[TZ_RULES_SIZE(1)];
+    size_t n = 1;
+    int errors = 0;
+
+    if (tz.saveRules(buf, sizeof(buf), &change, 1) != sizeof(EXPECTED) || memcmp(buf, EXPECTED, sizeof(buf)) != 0) {
+        printf("saveRules(): unexpected bytes\n");
+        errors++;
+    }
+    if (!back.loadRules(EXPECTED, sizeof(EXPECTED), Memory, &loaded, &n) || n != 1 || loaded.utc != change.utc
+        || loaded.offset != 120 || loaded.dst != 1 || back.toLocal(change.utc) != change.utc + 2 * SECS_PER_HOUR) {
+        printf("loadRules(): fixed bytes loaded wrong\n");
+        errors++;
+    }
+
+    // counts whose size wraps a 16 bit size_t (avr), e.g. 0xFFFF changes
+    memcpy(buf, EXPECTED, sizeof(buf));
+    buf[4] = buf[5] = 0xFF;
+    if (back.loadRules(buf, sizeof(buf)) || tz.saveRules(buf, sizeof(buf), &change, 0xFFFF) != 0) {
+        printf("saveRules()/loadRules(): 0xFFFF changes accepted in %d bytes\n", (int) sizeof(buf));
+        errors++;
+    }
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * Write the given bytes to a temporary file and return whether         *
+ * TZifTimezone::open() accepts it.                                     *
+ *----------------------------------------------------------------------*/
+static bool tzifOpens(const uint8_t *data, size_t size)
+{
+    char path[64];
+    bool ok = false;
+
+    snprintf(path, sizeof(path), "/tmp/tzbench-%d.tzif", (int) getpid());
+    FILE *f = fopen(path, "wb");
+    if (f) {
+        TZifTimezone tz;
+        fwrite(data, 1, size, f);
+        fclose(f);
+        ok = tz.open(path);
+        remove(path);
+    }
+    return ok;
+}
+
+/*----------------------------------------------------------------------*
+ * Check a TZifTimezone against localtime_r() on the same zoneinfo      *
+ * file, hourly from 1970 to 2040 and at random times from 1901 to      *
+ * 2100, and that malformed files (counts wrapping in 32 bits, a        *
+ * designation without NUL) are rejected. Zones missing from the host   *
+ * are skipped. Returns the number of mismatches.                       *
+ *----------------------------------------------------------------------*/
+static int checkTZif(int *zones)
+{
+    const time_t begin = INT32_MIN, end = 4102444800LL;    // 1901 to 2100
+    char path[256], tzenv[sizeof(path) + 1];
+    int errors = 0;
+
+    *zones = 0;
+    for (size_t z = 0; z < sizeof(TZIF_ZONES) / sizeof(TZIF_ZONES[0]); z++) {
+        TZifTimezone tz;
+        const char *abbrev;
+        struct tm tm;
+        time_t utc, local, back;
+
+        snprintf(path, sizeof(path), TZIF_DIR "%s", TZIF_ZONES[z]);
+        if (!tz.open(path)) continue;
+        snprintf(tzenv, sizeof(tzenv), ":%s", path);
+        setenv("TZ", tzenv, 1);
+        tzset();
+        (*zones)++;
+
+        for (long i = 0; i < 800000L && errors < 20; i++) {
+            utc = i < 613600L ? i * (time_t) SECS_PER_HOUR : begin + (time_t) random31() * 4 % (end - begin);
+            localtime_r(&utc, &tm);
+            local = tz.toLocal(utc, &abbrev);
+            if (local != utc + tm.tm_gmtoff || strcmp(abbrev, tm.tm_zone) != 0
+                || tz.utcIsDST(utc) != (tm.tm_isdst > 0)) {
+                printf("%s: TZifTimezone(%lld) = %lld %s %d, localtime_r %lld %s %d\n", TZIF_ZONES[z],
+                    (long long) utc, (long long) local, abbrev, tz.utcIsDST(utc),
+                    (long long) (utc + tm.tm_gmtoff), tm.tm_zone, tm.tm_isdst);
+                errors++;
+            }
+            back = tz.toUTC(local);
+            if (back != utc && !(back < utc && tz.toLocal(back) == local)) {
+                printf("%s: TZifTimezone toUTC(%lld) = %lld, expected %lld\n", TZIF_ZONES[z],
+                    (long long) local, (long long) back, (long long) utc);
+                errors++;
+            }
+        }
+    }
+
+    // a minimal valid file: empty version 1 block, version 2 block with
+    // one type "UTC", then the same with each defect
+    uint8_t file[44 + 44 + 6 + 4] = {'T', 'Z', 'i', 'f', '2'};
+    memcpy(file + 44, "TZif2", 5);
+    file[44 + 39] = 1;                  // typecnt
+    file[44 + 43] = 4;                  // charcnt
+    memcpy(file + 44 + 44 + 6, "UTC", 4);
+    if (!tzifOpens(file, sizeof(file))) {
+        printf("TZifTimezone: valid minimal file rejected\n");
+        errors++;
+    }
+    file[sizeof(file) - 1] = 'X';       // designation not NUL terminated
+    if (tzifOpens(file, sizeof(file))) {
+        printf("TZifTimezone: designation without NUL accepted\n");
+        errors++;
+    }
+
+    // version 1 timecnt 0x33333334, 4 data bytes once multiplied by 5 in
+    // 32 bits, followed by a valid version 2 block with one type
+    uint8_t wrap[44 + 4 + 44 + 6 + 4] = {'T', 'Z', 'i', 'f', '2'};
+    wrap[32] = wrap[33] = wrap[34] = 0x33;
+    wrap[35] = 0x34;
+    memcpy(wrap + 48, "TZif2", 5);
+    wrap[48 + 39] = 1;                  // typecnt
+    wrap[48 + 43] = 4;                  // charcnt
+    memcpy(wrap + 48 + 44 + 6, "UTC", 4);
+    if (tzifOpens(wrap, sizeof(wrap))) {
+        printf("TZifTimezone: header with wrapping counts accepted\n");
+        errors++;
+    }
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * Verify every zone, at random times and around each time change.      *
+ *----------------------------------------------------------------------*/
+static int verify()
+{
+    const time_t begin = 0, end = 4102444800LL;     // 1970 to 2100
+    int errors = 0, tzifZones;
+
+    for (size_t z = 0; z < sizeof(ZONES) / sizeof(ZONES[0]); z++) {
+        Timezone tz(UTC);
+        time_t t, change;
+
+        if (!tz.setRules(ZONES[z])) {
+            printf("%s: parse error\n", ZONES[z]);
+            errors++;
+            continue;
+        }
+        setenv("TZ", ZONES[z], 1);
+        tzset();
+
+        for (long i = 0; i < 200000L && errors < 20; i++)
+            errors += check(tz, ZONES[z], begin + (time_t) random31() * 2 % (end - begin));
+        for (t = begin; tz.nextTransition(t, &change) && change < end && errors < 20; t = change)
+            errors += check(tz, ZONES[z], change - 1) + check(tz, ZONES[z], change);
+
+        // every local time type and policy, around each time change
+        long offset1 = tz.toLocal(begin) - begin, offset2 = offset1;
+        if (tz.nextTransition(begin, &change)) offset2 = tz.toLocal(change) - change;
+        long minOffset = offset1 < offset2 ? offset1 : offset2;
+        long maxOffset = offset1 < offset2 ? offset2 : offset1;
+        for (t = begin; tz.nextTransition(t, &change) && change < end && errors < 20; t = change) {
+            for (time_t l = change + minOffset - SECS_PER_HOUR; l < change + maxOffset + SECS_PER_HOUR; l += 15 * SECS_PER_MIN)
+                errors += checkPolicy(tz, ZONES[z], l, minOffset, maxOffset);
+            errors += checkPolicy(tz, ZONES[z], change + minOffset - 1, minOffset, maxOffset)
+                + checkPolicy(tz, ZONES[z], change + minOffset, minOffset, maxOffset)
+                + checkPolicy(tz, ZONES[z], change + maxOffset - 1, minOffset, maxOffset)
+                + checkPolicy(tz, ZONES[z], change + maxOffset, minOffset, maxOffset);
+        }
+        for (long i = 0; i < 20000L && errors < 20; i++)
+            errors += checkPolicy(tz, ZONES[z], begin + (time_t) random31() * 2 % (end - begin), minOffset, maxOffset);
+        errors += checkBulk(tz, ZONES[z]);
+        errors += checkStream(tz, ZONES[z]);
+        errors += checkRules(tz, ZONES[z]);
+    }
+    errors += checkRulesBytes();
+    errors += checkStatic<CEST, CET>("StaticTimezone<CEST, CET>");
+    errors += checkStatic<JST, JST>("StaticTimezone<JST, JST>");
+    errors += checkTZif(&tzifZones);
+    printf("verify: %d zones, %d TZif zones, %s\n", (int) (sizeof(ZONES) / sizeof(ZONES[0])), tzifZones,
+        errors ? "FAILED" : "ok");
+    return errors;
+}
+
+/*----------------------------------------------------------------------*
+ * The measured operations, one per overload.                           *
+ *----------------------------------------------------------------------*/
+enum op_t {ToLocal, ToLocalTcr, ToLocalTm, ToLocalTmTm, ToLocalN, ToUTC, ToUTCN,
+    UtcIsDST, UtcIsDSTTm, LocIsDST, LocIsDSTTm, BulkToLocal, BulkUtcIsDST,
+    StreamToLocal, Format, FormatN, Strftime, OPS};
+
+static const char *OP_NAMES[OPS] = {
+    "toLocal(utc)", "toLocal(utc, tcr)", "toLocal(utc, tm, tcr)", "toLocal(tm, tm, tcr)",
+    "toLocal(utc[], local[], n)", "toUTC(local)", "toUTC(local[], utc[], n)",
+    "utcIsDST(utc)", "utcIsDST(tm)", "locIsDST(local)", "locIsDST(tm)",
+    "TimezoneBulk::toLocal()", "TimezoneBulk::utcIsDST()", "TimezoneStream::toLocal()",
+    "format(utc, buf)", "format(utc[], buf[], n)", "localtime_r() + strftime()",
+};
+
+static time_t sink;
+
+/*----------------------------------------------------------------------*
+ * Run the given operation on the timestamps (and their struct tm)      *
+ * until ops conversions are done.                                      *
+ *----------------------------------------------------------------------*/
+static void run(Timezone &tz, TimezoneBulk &bulk, TimezoneStream &stream, int op, const time_t *t, struct tm *tm, long ops)
+{
+    static time_t out[BENCH_SIZE];
+    static bool dst[BENCH_SIZE];
+    static char buf[BENCH_SIZE][TZ_FORMAT_SIZE];
+    TimeChangeRule *tcr;
+    struct tm tm_local;
+    time_t sum = 0;
+
+    for (long n = 0; n < ops; n += BENCH_SIZE) {
+        switch (op) {
+            case ToLocal:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.toLocal(t[i]);
+                break;
+            case ToLocalTcr:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.toLocal(t[i], &tcr);
+                break;
+            case ToLocalTm:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.toLocal(t[i], &tm_local, &tcr);
+                break;
+            case ToLocalTmTm:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.toLocal(&tm[i], &tm_local, &tcr);
+                break;
+            case ToLocalN:
+                tz.toLocal(t, out, BENCH_SIZE);
+                sum += out[BENCH_SIZE - 1];
+                break;
+            case ToUTC:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.toUTC(t[i]);
+                break;
+            case ToUTCN:
+                tz.toUTC(t, out, BENCH_SIZE);
+                sum += out[BENCH_SIZE - 1];
+                break;
+            case UtcIsDST:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.utcIsDST(t[i]);
+                break;
+            case UtcIsDSTTm:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.utcIsDST(&tm[i]);
+                break;
+            case LocIsDST:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.locIsDST(t[i]);
+                break;
+            case LocIsDSTTm:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.locIsDST(&tm[i]);
+                break;
+            case BulkToLocal:
+                bulk.toLocal(t, out, BENCH_SIZE);
+                sum += out[BENCH_SIZE - 1];
+                break;
+            case BulkUtcIsDST:
+                bulk.utcIsDST(t, dst, BENCH_SIZE);
+                sum += dst[BENCH_SIZE - 1];
+                break;
+            case StreamToLocal:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += stream.toLocal(t[i]);
+                break;
+            case Format:
+                for (int i = 0; i < BENCH_SIZE; i++) sum += tz.format(t[i], buf[i]);
+                break;
+            case FormatN:
+                tz.format(t, buf, BENCH_SIZE);
+                sum += buf[BENCH_SIZE - 1][18];
+                break;
+            case Strftime:
+                for (int i = 0; i < BENCH_SIZE; i++) {
+                    localtime_r(&t[i], &tm_local);
+                    sum += strftime(buf[i], TZ_FORMAT_SIZE, "%Y-%m-%d %H:%M:%S %Z", &tm_local);
+                }
+                break;
+        }
+    }
+    sink += sum;
+}
+
+#ifdef TZ_STATS
+static const char *STAT_NAMES[TZ_STATS_CALLS] = {
+    "toLocal(utc)", "toLocal(utc, tcr)", "toLocal(utc, tm, tcr)", "toLocal(tm, tm, tcr)",
+    "toLocal(utc[], local[], n)", "toUTC(local)", "toUTC(local[], utc[], n)", "toUTC(local, utc, policy)",
+    "utcIsDST(utc)", "utcIsDST(tm)", "locIsDST(local)", "locIsDST(tm)",
+};
+
+static void printStat(tzCall_t call, int bin, uint32_t count)
+{
+    if (bin < 0)
+        printf("%-28s %10lu\n", STAT_NAMES[call], (unsigned long) count);
+    else
+        printf("%-28s %10lu  %lu+ cycles\n", "", (unsigned long) count, 1UL << bin);
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    static time_t t[BENCH_SIZE];
+    static struct tm tm[BENCH_SIZE];
+    static const char *PATTERNS[] = {"sequential", "random", "new year"};
+    const time_t start = 1514764800LL;          // 2018-01-01 00:00:00 UTC
+    bool verifyOnly = false;
+    long ops = BENCH_OPS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verify") == 0)
+            verifyOnly = true;
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            ops = atol(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--verify] [-n count]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (verify()) return 1;
+    if (verifyOnly) return 0;
+
+    Timezone tz(UTC);
+    tz.setRules(ZONES[0]);
+    TimezoneBulk bulk(tz);
+    TimezoneStream stream(tz);
+    setenv("TZ", ZONES[0], 1);      // for the strftime() baseline
+    tzset();
+    printf("\n%-28s %-12s %10s %10s\n", "overload", "pattern", "ns/op", "cycles/op");
+    for (int op = 0; op < OPS; op++) {
+        for (int p = 0; p < 3; p++) {
+            for (int i = 0; i < BENCH_SIZE; i++) {
+                switch (p) {
+                    case 0: t[i] = start + i * (time_t) SECS_PER_MIN; break;
+                    case 1: t[i] = (time_t) random31() * 2 % 4102444800LL; break;     // 1970-2100
+                    case 2: t[i] = start - SECS_PER_HOUR + (i & 1) * 2 * SECS_PER_HOUR; break;
+                }
+                gmtime_r(&t[i], &tm[i]);
+            }
+            run(tz, bulk, stream, op, t, tm, BENCH_SIZE);     // warm up
+
+            double ns = now();
+            unsigned long long cy = cycles();
+            run(tz, bulk, stream, op, t, tm, ops);
+            cy = cycles() - cy;
+            ns = now() - ns;
+
+            long n = (ops + BENCH_SIZE - 1) / BENCH_SIZE * BENCH_SIZE;
+#ifdef HAVE_CYCLES
+            printf("%-28s %-12s %10.2f %10.1f\n", OP_NAMES[op], PATTERNS[p], ns / n, (double) cy / n);
+#else
+            printf("%-28s %-12s %10.2f %10s\n", OP_NAMES[op], PATTERNS[p], ns / n, "-");
+#endif
+        }
+    }
+#ifdef TZ_STATS
+    printf("\nstatistics of the benchmark Timezone\n");
+    printf("%-28s %10lu\n%-28s %10lu\n%-28s %10lu\n", "hits", (unsigned long) tz.getStats().hits,
+        "misses", (unsigned long) tz.getStats().misses, "calcs", (unsigned long) tz.getStats().calcs);
+    tz.dumpStats(printStat);
+#endif
+    return 0;
+}